@@ -20,6 +20,32 @@ int posix_spawnp(pid_t *pid, const char *file,
     posix_spawnp_fun_t ps = dlsym(RTLD_NEXT, "posix_spawnp");
     return ps(pid, file, file_actions, attrp, argv, envp);
     */
-    return __spawni(pid, file, file_actions, attrp, argv, envp, SPAWN_XFLAGS_USE_PATH);
+    return __spawni(pid, NULL, file, file_actions, attrp, argv, envp, SPAWN_XFLAGS_USE_PATH);
 }
 
+/* Spawn FILE without a $PATH search; FILE must name the executable.  */
+int posix_spawn(pid_t *pid, const char *file,
+                const posix_spawn_file_actions_t *file_actions,
+                const posix_spawnattr_t *attrp,
+                char *const argv[], char *const envp[])
+{
+    return __spawni(pid, NULL, file, file_actions, attrp, argv, envp, 0);
+}
+
+/* Like posix_spawn, but also return a pidfd for the child in *PIDFD.  */
+int posix_spawn_pidfd_np(pid_t *pid, int *pidfd, const char *file,
+                const posix_spawn_file_actions_t *file_actions,
+                const posix_spawnattr_t *attrp,
+                char *const argv[], char *const envp[])
+{
+    return __spawni(pid, pidfd, file, file_actions, attrp, argv, envp, 0);
+}
+
+/* Like posix_spawnp, but also return a pidfd for the child in *PIDFD.  */
+int posix_spawnp_pidfd_np(pid_t *pid, int *pidfd, const char *file,
+                const posix_spawn_file_actions_t *file_actions,
+                const posix_spawnattr_t *attrp,
+                char *const argv[], char *const envp[])
+{
+    return __spawni(pid, pidfd, file, file_actions, attrp, argv, envp, SPAWN_XFLAGS_USE_PATH);
+}
@@ -91,6 +91,103 @@ extern int posix_spawnp (pid_t *__pid, const char *__file,
     __nonnull ((2, 5));
 
 
+#ifdef __USE_GNU
+/* Like `posix_spawn' and `posix_spawnp', but additionally store a pidfd
+   referring to the new process in *PIDFD.  The pidfd is close-on-exec.
+   If the kernel supports neither CLONE_PIDFD nor pidfd_open, *PIDFD is
+   set to -1 and the process is still created.  */
+extern int posix_spawn_pidfd_np (pid_t *__restrict __pid,
+				 int *__restrict __pidfd,
+				 const char *__restrict __path,
+				 const posix_spawn_file_actions_t *__restrict
+				 __file_actions,
+				 const posix_spawnattr_t *__restrict __attrp,
+				 char *const __argv[__restrict_arr],
+				 char *const __envp[__restrict_arr])
+    __nonnull ((2, 3, 6));
+
+extern int posix_spawnp_pidfd_np (pid_t *__pid, int *__pidfd,
+				  const char *__file,
+				  const posix_spawn_file_actions_t *__file_actions,
+				  const posix_spawnattr_t *__attrp,
+				  char *const __argv[], char *const __envp[])
+    __nonnull ((2, 3, 6));
+
+/* Limit the memory kept in the cache of child stacks that `posix_spawn'
+   reuses across calls to MAX_BYTES.  Zero disables the cache and releases
+   all cached stacks.  Returns the previous limit.  */
+extern size_t posix_spawn_set_stack_cache_np (size_t __max_bytes) __THROW;
+
+/* Declare SET as the signals for which the program may have handlers
+   installed when it calls `posix_spawn'.  Before exec, the child then
+   resets only these signals (and those in the POSIX_SPAWN_SETSIGDEF set)
+   to SIG_DFL instead of checking every signal with two sigaction calls
+   each.  A handler installed for a signal outside SET might run in the
+   child, which shares the parent's memory, so SET must be complete.
+   Passing NULL restores the default of checking all signals.  */
+extern int posix_spawn_set_handled_signals_np (const sigset_t *__set) __THROW;
+
+/* One stage of a pipeline started by `posix_spawn_pipeline'.  PATH, ARGV,
+   FLAGS, FN and ENVP are filled in by the caller; PID, PIDFD and ERROR are
+   filled in by `posix_spawn_pipeline'.  */
+struct posix_spawn_stage
+{
+  const char *path;		/* Program to run; ARGV[0] if NULL.  */
+  char *const *argv;		/* Argument vector, NULL terminated.  */
+  int flags;			/* POSIX_SPAWN_STAGE_* flags.  */
+  int (*fn) (char *const *);	/* If not NULL, fork and call FN (ARGV)
+				   instead of running PATH.  */
+  char *const *envp;		/* Environment for PATH, or NULL to use
+				   the pipeline's ENVP.  */
+  pid_t pid;			/* Child pid, or -1 if it was not started.  */
+  int pidfd;			/* pidfd for the child, or -1.  */
+  int error;			/* Error number if it was not started.  */
+};
+
+/* Flags for `struct posix_spawn_stage'.  */
+# define POSIX_SPAWN_STAGE_USEPATH	0x01	/* Search PATH for PATH.  */
+# define POSIX_SPAWN_STAGE_STDERR	0x02	/* Send stderr along stdout.  */
+
+/* Where the first stage of a pipeline reads from and the last stage
+   writes to.  A file name takes precedence over a descriptor; -1 and
+   NULL leave the stream alone.  */
+struct posix_spawn_pipeline_io
+{
+  const char *infile;		/* Opened O_RDONLY as standard input.  */
+  int infd;			/* Duplicated onto standard input.  */
+  const char *outfile;		/* Opened as standard output with
+				   O_WRONLY | O_CREAT | OUTFLAGS.  */
+  int outflags;			/* E.g. O_TRUNC or O_APPEND.  */
+  int outfd;			/* Duplicated onto standard output.  */
+};
+
+/* Start the NSTAGES programs in STAGES as one pipeline: the standard
+   output of each stage is connected to the standard input of the next,
+   and the ends of the pipeline are redirected as described by *IO, which
+   may be NULL.  If *ATTRP sets POSIX_SPAWN_SETPGROUP, all stages are
+   put into one process group, which the first stage to start leads
+   unless the group named is nonzero; otherwise the stages stay in the
+   caller's group.  POSIX_SPAWN_TCSETPGROUP in *ATTRP is applied only by
+   the first stage to start.
+
+   A stage with FN set runs FN in a forked copy of the caller, which
+   exits with FN's return value; the caller should flush its stdio
+   streams first.
+
+   A stage that cannot be started does not prevent the others from
+   starting; its PID is -1 and its ERROR holds the reason.  Returns 0 if
+   every stage was started, or else the error number of the first stage
+   that failed (or of the pipe creation, in which case nothing was
+   started).  */
+extern int posix_spawn_pipeline (struct posix_spawn_stage *__stages,
+				 size_t __nstages,
+				 const struct posix_spawn_pipeline_io *__io,
+				 const posix_spawnattr_t *__attrp,
+				 char *const __envp[])
+    __nonnull ((1));
+#endif
+
+
 /* Initialize data structure with attributes for `spawn' to default values.  */
 extern int posix_spawnattr_init (posix_spawnattr_t *__attr)
     __THROW __nonnull ((1));
@@ -69,11 +69,16 @@ struct __spawn_action
 extern int __posix_spawn_file_actions_realloc (posix_spawn_file_actions_t *
 					       file_actions);
 
-extern int __spawni (pid_t *pid, const char *path,
+extern int __spawni (pid_t *pid, int *pidfd, const char *path,
 		     const posix_spawn_file_actions_t *file_actions,
 		     const posix_spawnattr_t *attrp, char *const argv[],
 		     char *const envp[], int xflags);
 
+extern int __spawni_fn (pid_t *pid, int *pidfd,
+			const posix_spawn_file_actions_t *file_actions,
+			const posix_spawnattr_t *attrp,
+			int (*fn) (char *const *), char *const argv[]);
+
 /* Return true if FD falls into the range valid for file descriptors.
    The check in this form is mandated by POSIX.  */
 bool __spawn_valid_fd (int fd);
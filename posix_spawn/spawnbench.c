@@ -0,0 +1,176 @@
+/*
+ * Microbenchmark for posix_spawn.
+ *
+ * Spawns /bin/true repeatedly, in batches shaped like a 5-stage pipeline,
+ * with the child stack cache disabled, with it enabled, and with the cache
+ * enabled and the program's handled signals declared (so the child skips
+ * the sigaction sweep), and reports spawns per second for each.
+ * Then starts the same batches as real pipelines, once stage by stage
+ * with a posix_spawn_file_actions_t per stage (as cush used to) and once
+ * with posix_spawn_pipeline, and reports pipelines per second.
+ *
+ * Usage: ./spawnbench [number of spawns]
+ */
+#define _GNU_SOURCE
+#include "spawn.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <signal.h>
+#include <sys/wait.h>
+
+extern char **environ;
+
+#define STAGES 5
+
+static double
+now (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Return spawns per second, counting only time spent in posix_spawn.  */
+static double
+run (int n)
+{
+  char *argv[] = { "true", NULL };
+  double spent = 0;
+
+  for (int i = 0; i < n; i += STAGES)
+    {
+      pid_t pids[STAGES];
+      for (int j = 0; j < STAGES; j++)
+	{
+	  double start = now ();
+	  if (posix_spawn (&pids[j], "/bin/true", NULL, NULL, argv, environ))
+	    {
+	      perror ("posix_spawn");
+	      exit (EXIT_FAILURE);
+	    }
+	  spent += now () - start;
+	}
+      for (int j = 0; j < STAGES; j++)
+	waitpid (pids[j], NULL, 0);
+    }
+  return n / spent;
+}
+
+/* Return pipelines per second, starting each stage with its own
+   file actions and creating each pipe just before it is needed.  */
+static double
+run_stagewise (int n, const posix_spawnattr_t *attr)
+{
+  char *argv[] = { "true", NULL };
+  double spent = 0;
+
+  for (int i = 0; i < n; i += STAGES)
+    {
+      pid_t pids[STAGES];
+      int prev = -1;
+      posix_spawnattr_t stage_attr = *attr;
+      double start = now ();
+      for (int j = 0; j < STAGES; j++)
+	{
+	  posix_spawn_file_actions_t fa;
+	  int fds[2] = { -1, -1 };
+	  posix_spawn_file_actions_init (&fa);
+	  if (prev != -1)
+	    posix_spawn_file_actions_adddup2 (&fa, prev, STDIN_FILENO);
+	  if (j < STAGES - 1)
+	    {
+	      pipe2 (fds, O_CLOEXEC);
+	      posix_spawn_file_actions_adddup2 (&fa, fds[1], STDOUT_FILENO);
+	    }
+	  if (posix_spawn (&pids[j], "/bin/true", &fa, &stage_attr, argv,
+			   environ))
+	    {
+	      perror ("posix_spawn");
+	      exit (EXIT_FAILURE);
+	    }
+	  posix_spawn_file_actions_destroy (&fa);
+	  if (j == 0)
+	    posix_spawnattr_setpgroup (&stage_attr, pids[0]);
+	  if (prev != -1)
+	    close (prev);
+	  if (fds[1] != -1)
+	    close (fds[1]);
+	  prev = fds[0];
+	}
+      spent += now () - start;
+      for (int j = 0; j < STAGES; j++)
+	waitpid (pids[j], NULL, 0);
+    }
+  return n / STAGES / spent;
+}
+
+/* Return pipelines per second using posix_spawn_pipeline.  */
+static double
+run_pipeline (int n, const posix_spawnattr_t *attr)
+{
+  char *argv[] = { "true", NULL };
+  struct posix_spawn_stage stages[STAGES];
+  double spent = 0;
+
+  for (int j = 0; j < STAGES; j++)
+    stages[j] = (struct posix_spawn_stage) { .path = "/bin/true",
+					     .argv = argv };
+  for (int i = 0; i < n; i += STAGES)
+    {
+      double start = now ();
+      if (posix_spawn_pipeline (stages, STAGES, NULL, attr, environ))
+	{
+	  perror ("posix_spawn_pipeline");
+	  exit (EXIT_FAILURE);
+	}
+      spent += now () - start;
+      for (int j = 0; j < STAGES; j++)
+	waitpid (stages[j].pid, NULL, 0);
+      for (int j = 0; j < STAGES; j++)
+	close (stages[j].pidfd);
+    }
+  return n / STAGES / spent;
+}
+
+int
+main (int ac, char *av[])
+{
+  int n = ac > 1 ? atoi (av[1]) : 20000;
+
+  size_t limit = posix_spawn_set_stack_cache_np (0);
+  run (STAGES * 10);		/* warm up */
+  double off = run (n);
+
+  posix_spawn_set_stack_cache_np (limit);
+  run (STAGES * 10);
+  double on = run (n);
+
+  sigset_t none;
+  sigemptyset (&none);
+  posix_spawn_set_handled_signals_np (&none);
+  run (STAGES * 10);
+  double nosweep = run (n);
+
+  printf ("%d spawns, %d per batch\n", n, STAGES);
+  printf ("stack cache off:           %10.0f spawns/sec\n", off);
+  printf ("stack cache on:            %10.0f spawns/sec (%+.1f%%)\n", on,
+	  (on / off - 1) * 100);
+  printf ("cache on, no signal sweep: %10.0f spawns/sec (%+.1f%%)\n", nosweep,
+	  (nosweep / off - 1) * 100);
+
+  posix_spawnattr_t attr;
+  posix_spawnattr_init (&attr);
+  posix_spawnattr_setflags (&attr, POSIX_SPAWN_SETPGROUP);
+  run_stagewise (STAGES * 10, &attr);
+  double stagewise = run_stagewise (n, &attr);
+  run_pipeline (STAGES * 10, &attr);
+  double pipeline = run_pipeline (n, &attr);
+
+  printf ("stage by stage:            %10.0f pipelines/sec\n", stagewise);
+  printf ("posix_spawn_pipeline:      %10.0f pipelines/sec (%+.1f%%)\n",
+	  pipeline, (pipeline / stagewise - 1) * 100);
+  return 0;
+}
@@ -40,6 +40,7 @@
 #include <signal.h>
 #include <pthread.h>
 #include <unistd.h>
+#include <sys/syscall.h>
 #define __pthread_setcancelstate pthread_setcancelstate
 #define __setpgid setpgid
 #define __getpgrp getpgrp
@@ -47,6 +48,9 @@
 #define __getuid getuid
 #define __tcsetpgrp tcsetpgrp
 #define __close_nocancel close
+#define __read_nocancel read
+#define __write_nocancel write
+#define __fork fork
 #define __getrlimit64 getrlimit64
 #define __open_nocancel open
 #define __fcntl fcntl
@@ -133,14 +137,33 @@ _Static_assert (sizeof (posix_spawnattr_t) == 336,
    normal program exit with the exit code 127.  */
 #define SPAWN_ERROR	127
 
+/* With CLONE_PIDFD the kernel stores a pidfd for the child at the
+   parent_tid argument, passed here as __pidfd.  */
 #ifdef __ia64__
-# define CLONE(__fn, __stackbase, __stacksize, __flags, __args) \
-  __clone2 (__fn, __stackbase, __stacksize, __flags, __args, 0, 0, 0)
+# define CLONE(__fn, __stackbase, __stacksize, __flags, __args, __pidfd) \
+  __clone2 (__fn, __stackbase, __stacksize, __flags, __args, __pidfd, 0, 0)
 #else
-# define CLONE(__fn, __stack, __stacksize, __flags, __args) \
-  __clone (__fn, __stack, __flags, __args)
+# define CLONE(__fn, __stack, __stacksize, __flags, __args, __pidfd) \
+  __clone (__fn, __stack, __flags, __args, __pidfd)
 #endif
 
+#ifndef CLONE_PIDFD
+# define CLONE_PIDFD 0x00001000
+#endif
+
+/* Open a pidfd for PID, for kernels that do not support CLONE_PIDFD.
+   Returns -1 if pidfds are not supported at all.  */
+static int
+__pidfd_open (pid_t pid)
+{
+#ifdef SYS_pidfd_open
+  return syscall (SYS_pidfd_open, pid, 0);
+#else
+  errno = ENOSYS;
+  return -1;
+#endif
+}
+
 /* Since ia64 wants the stackbase w/clone2, re-use the grows-up macro.  */
 #if _STACK_GROWS_UP || defined (__ia64__)
 # define STACK(__stack, __stack_size) (__stack)
@@ -149,6 +172,126 @@ _Static_assert (sizeof (posix_spawnattr_t) == 336,
 #endif
 
 
+/* Child stacks are cached for reuse instead of being mapped and unmapped
+   on every spawn, which costs two VMA operations plus page faults on the
+   fresh stack.  Stacks are grouped in power-of-two size classes starting
+   at 64 KiB; larger requests bypass the cache.  Stacks are only retained
+   while the total stays below stack_cache.max_bytes, which can be changed
+   with posix_spawn_set_stack_cache_np (0 disables the cache).  */
+#define STACK_CACHE_MIN_SHIFT	16
+#define STACK_CACHE_CLASSES	8
+#define STACK_CACHE_PER_CLASS	4
+#define STACK_CACHE_DEFAULT_MAX	(1024 * 1024)
+
+static struct
+{
+  pthread_mutex_t lock;
+  void *stacks[STACK_CACHE_CLASSES][STACK_CACHE_PER_CLASS];
+  int count[STACK_CACHE_CLASSES];
+  size_t bytes;			/* Bytes currently held in the cache.  */
+  size_t max_bytes;		/* Upper limit on BYTES.  */
+} stack_cache =
+{
+  .lock = PTHREAD_MUTEX_INITIALIZER,
+  .max_bytes = STACK_CACHE_DEFAULT_MAX,
+};
+
+/* Return the size class for a stack of SIZE bytes, or -1 if it is too
+   large to be cached.  */
+static int
+__spawn_stack_class (size_t size)
+{
+  for (int c = 0; c < STACK_CACHE_CLASSES; c++)
+    if (size <= ((size_t) 1 << (STACK_CACHE_MIN_SHIFT + c)))
+      return c;
+  return -1;
+}
+
+/* Obtain a child stack of at least *SIZE bytes, updating *SIZE to the
+   size actually mapped.  Returns MAP_FAILED on error.  */
+static void *
+__spawn_stack_get (size_t *size, int prot)
+{
+  int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK;
+
+  pthread_mutex_lock (&stack_cache.lock);
+  int c = stack_cache.max_bytes > 0 ? __spawn_stack_class (*size) : -1;
+  if (c >= 0)
+    {
+      *size = (size_t) 1 << (STACK_CACHE_MIN_SHIFT + c);
+      if (stack_cache.count[c] > 0)
+	{
+	  void *stack = stack_cache.stacks[c][--stack_cache.count[c]];
+	  stack_cache.bytes -= *size;
+	  pthread_mutex_unlock (&stack_cache.lock);
+	  return stack;
+	}
+      /* This stack will be reused; fault it in once now.  */
+      flags |= MAP_POPULATE;
+    }
+  pthread_mutex_unlock (&stack_cache.lock);
+
+  return __mmap (NULL, *size, prot, flags, -1, 0);
+}
+
+/* Return a child stack obtained from __spawn_stack_get.  */
+static void
+__spawn_stack_put (void *stack, size_t size)
+{
+  pthread_mutex_lock (&stack_cache.lock);
+  int c = __spawn_stack_class (size);
+  if (c >= 0 && size == ((size_t) 1 << (STACK_CACHE_MIN_SHIFT + c))
+      && stack_cache.count[c] < STACK_CACHE_PER_CLASS
+      && stack_cache.bytes + size <= stack_cache.max_bytes)
+    {
+      stack_cache.stacks[c][stack_cache.count[c]++] = stack;
+      stack_cache.bytes += size;
+      stack = NULL;
+    }
+  pthread_mutex_unlock (&stack_cache.lock);
+
+  if (stack != NULL)
+    __munmap (stack, size);
+}
+
+/* Set the limit on memory retained in the stack cache and return the
+   previous limit.  Cached stacks beyond the new limit are released.  */
+size_t
+posix_spawn_set_stack_cache_np (size_t max_bytes)
+{
+  pthread_mutex_lock (&stack_cache.lock);
+  size_t old = stack_cache.max_bytes;
+  stack_cache.max_bytes = max_bytes;
+  for (int c = STACK_CACHE_CLASSES - 1;
+       c >= 0 && stack_cache.bytes > max_bytes; c--)
+    while (stack_cache.count[c] > 0 && stack_cache.bytes > max_bytes)
+      {
+	size_t size = (size_t) 1 << (STACK_CACHE_MIN_SHIFT + c);
+	__munmap (stack_cache.stacks[c][--stack_cache.count[c]], size);
+	stack_cache.bytes -= size;
+      }
+  pthread_mutex_unlock (&stack_cache.lock);
+  return old;
+}
+
+/* Signals for which the program may have a handler installed, as declared
+   with posix_spawn_set_handled_signals_np.  Only valid if
+   HANDLED_SIGNALS_KNOWN; otherwise every signal must be checked.  */
+static sigset_t handled_signals;
+static bool handled_signals_known;
+
+/* Declare the set of signals for which the program may install handlers,
+   so the child only resets those.  NULL goes back to checking all signals.
+   Must not be called concurrently with a spawn.  */
+int
+posix_spawn_set_handled_signals_np (const sigset_t *set)
+{
+  if (set != NULL)
+    handled_signals = *set;
+  handled_signals_known = set != NULL;
+  return 0;
+}
+
 struct posix_spawn_args
 {
   sigset_t oldmask;
@@ -161,6 +304,8 @@ struct posix_spawn_args
   char *const *envp;
   int xflags;
   int err;
+  int (*fn) (char *const *);	/* Call instead of exec, see __spawni_fn.  */
+  int errfd;			/* Report ERR here if not sharing memory.  */
 };
 
 /* Older version requires that shell script without shebang definition
@@ -200,15 +345,21 @@ __spawni_child (void *arguments)
 
   /* The child must ensure that no signal handler are enabled because it shared
      memory with parent, so the signal disposition must be either SIG_DFL or
-     SIG_IGN.  It does by iterating over all signals and although it could
-     possibly be more optimized (by tracking which signal potentially have a
-     signal handler), it might requires system specific solutions (since the
-     sigset_t data type can be very different on different architectures).  */
+     SIG_IGN.  Unless the program declared which signals it handles with
+     posix_spawn_set_handled_signals_np, it does so by iterating over all
+     signals, which costs two sigaction calls per signal.  */
   struct sigaction sa;
   memset (&sa, '\0', sizeof (sa));
 
   sigset_t hset;
-  __sigprocmask (SIG_BLOCK, 0, &hset);
+  if (handled_signals_known)
+    hset = handled_signals;
+  else
+    __sigprocmask (SIG_BLOCK, 0, &hset);
+
+  if ((attr->__flags & POSIX_SPAWN_SETSIGDEF) == 0 && sigisemptyset (&hset))
+    goto signals_done;
+
   for (int sig = 1; sig < _NSIG; ++sig)
     {
       if ((attr->__flags & POSIX_SPAWN_SETSIGDEF)
@@ -233,6 +384,7 @@ __spawni_child (void *arguments)
 
       __libc_sigaction (sig, &sa, 0);
     }
+signals_done:
 
 #ifdef _POSIX_PRIORITY_SCHEDULING
   /* Set the scheduling algorithm and parameters.  */
@@ -374,6 +526,12 @@ __spawni_child (void *arguments)
   __sigprocmask (SIG_SETMASK, (attr->__flags & POSIX_SPAWN_SETSIGMASK)
 		 ? &attr->__ss : &args->oldmask, 0);
 
+  if (args->fn != NULL)
+    {
+      __close_nocancel (args->errfd);
+      _exit (args->fn (args->argv));
+    }
+
   args->exec (args->file, args->argv, args->envp);
 
   /* This is compatibility function required to enable posix_spawn run
@@ -388,13 +546,17 @@ fail:
      be to set args->err to some negative sentinel and have the parent
      abort(), but that seems needlessly harsh.  */
   args->err = errno ? : ECHILD;
+  if (args->errfd >= 0)
+    __write_nocancel (args->errfd, &args->err, sizeof (args->err));
   _exit (SPAWN_ERROR);
 }
 
 /* Spawn a new process executing PATH with the attributes describes in *ATTRP.
-   Before running the process perform the actions described in FILE-ACTIONS. */
+   Before running the process perform the actions described in FILE-ACTIONS.
+   If PIDFD is not NULL, store a pidfd for the new process there (or -1 if
+   the kernel cannot provide one).  */
 static int
-__spawnix (pid_t * pid, const char *file,
+__spawnix (pid_t * pid, int *pidfd, const char *file,
 	   const posix_spawn_file_actions_t * file_actions,
 	   const posix_spawnattr_t * attrp, char *const argv[],
 	   char *const envp[], int xflags,
@@ -432,8 +594,7 @@ __spawnix (pid_t * pid, const char *file,
      extra pages won't actually be allocated unless they get used.  */
   argv_size += (32 * 1024);
   size_t stack_size = ALIGN_UP (argv_size, GLRO(dl_pagesize));
-  void *stack = __mmap (NULL, stack_size, prot,
-			MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
+  void *stack = __spawn_stack_get (&stack_size, prot);
   if (__glibc_unlikely (stack == MAP_FAILED))
     return errno;
 
@@ -452,6 +613,8 @@ __spawnix (pid_t * pid, const char *file,
   args.argc = argc;
   args.envp = envp;
   args.xflags = xflags;
+  args.fn = NULL;
+  args.errfd = -1;
 
   __libc_signal_block_all (&args.oldmask);
 
@@ -463,8 +626,29 @@ __spawnix (pid_t * pid, const char *file,
      need for CLONE_SETTLS.  Although parent and child share the same TLS
      namespace, there will be no concurrent access for TLS variables (errno
      for instance).  */
+  int clone_flags = CLONE_VM | CLONE_VFORK | SIGCHLD;
+  int new_pidfd = -1;
+  if (pidfd != NULL)
+    clone_flags |= CLONE_PIDFD;
+
   new_pid = CLONE (__spawni_child, STACK (stack, stack_size), stack_size,
-		   CLONE_VM | CLONE_VFORK | SIGCHLD, &args);
+		   clone_flags, &args, &new_pidfd);
+
+  /* If the kernel rejects CLONE_PIDFD, spawn without it; pidfd_open is
+     tried below.  Kernels that predate CLONE_PIDFD ignore the flag and
+     leave NEW_PIDFD untouched.  If the pidfd itself is what failed, out
+     of descriptors, spawn without one and report -1: the caller can do
+     without it, but not without the child.  */
+  bool no_fds = false;
+  if (new_pid < 0 && (clone_flags & CLONE_PIDFD))
+    {
+      int clone_errno = errno;
+      no_fds = clone_errno == EMFILE || clone_errno == ENFILE;
+      if (clone_errno == EINVAL || no_fds)
+	new_pid = CLONE (__spawni_child, STACK (stack, stack_size),
+			 stack_size, clone_flags & ~CLONE_PIDFD, &args,
+			 &new_pidfd);
+    }
 
   /* It needs to collect the case where the auxiliary process was created
      but failed to execute the file (due either any preparation step or
@@ -488,13 +672,26 @@ __spawnix (pid_t * pid, const char *file,
 	__waitpid (new_pid, NULL, 0);
     }
   else
-    ec = -new_pid;
+    ec = errno;
 
-  __munmap (stack, stack_size);
+  __spawn_stack_put (stack, stack_size);
 
   if ((ec == 0) && (pid != NULL))
     *pid = new_pid;
 
+  if (pidfd != NULL)
+    {
+      if (ec == 0 && new_pidfd < 0 && !no_fds)
+	/* The child cannot have been reaped yet, so the pid is still ours.  */
+	new_pidfd = __pidfd_open (new_pid);
+      else if (ec != 0 && new_pidfd >= 0)
+	{
+	  __close_nocancel (new_pidfd);
+	  new_pidfd = -1;
+	}
+      *pidfd = new_pidfd;
+    }
+
   __libc_signal_restore_set (&args.oldmask);
 
   __pthread_setcancelstate (state, NULL);
@@ -505,13 +702,81 @@ __spawnix (pid_t * pid, const char *file,
 /* Spawn a new process executing PATH with the attributes describes in *ATTRP.
    Before running the process perform the actions described in FILE-ACTIONS. */
 int
-__spawni (pid_t * pid, const char *file,
+__spawni (pid_t * pid, int *pidfd, const char *file,
 	  const posix_spawn_file_actions_t * acts,
 	  const posix_spawnattr_t * attrp, char *const argv[],
 	  char *const envp[], int xflags)
 {
   /* It uses __execvpex to avoid run ENOEXEC in non compatibility mode (it
      will be handled by maybe_script_execute).  */
-  return __spawnix (pid, file, acts, attrp, argv, envp, xflags,
+  return __spawnix (pid, pidfd, file, acts, attrp, argv, envp, xflags,
 		    xflags & SPAWN_XFLAGS_USE_PATH ? __execvpex :__execve);
 }
+
+/* Run FN (ARGV) in a child created with fork instead of executing a file,
+   after applying *ATTRP and FILE-ACTIONS as for __spawni; FN's return
+   value becomes the child's exit status.  The child does not share memory
+   with the parent, so it may run arbitrary code, and it reports setup
+   errors through a close-on-exec pipe instead of through ARGS.  Callers
+   should flush stdio streams first, since the child inherits their
+   buffers.  */
+int
+__spawni_fn (pid_t * pid, int *pidfd,
+	     const posix_spawn_file_actions_t * file_actions,
+	     const posix_spawnattr_t * attrp,
+	     int (*fn) (char *const *), char *const argv[])
+{
+  struct posix_spawn_args args;
+  int errpipe[2];
+  int ec = 0;
+
+  if (pipe2 (errpipe, O_CLOEXEC) != 0)
+    return errno;
+
+  int state;
+  __pthread_setcancelstate (PTHREAD_CANCEL_DISABLE, &state);
+
+  args.err = 0;
+  args.file = NULL;
+  args.exec = NULL;
+  args.fa = file_actions;
+  args.attr = attrp ? attrp : &(const posix_spawnattr_t) { 0 };
+  args.argv = argv;
+  args.argc = 0;
+  args.envp = NULL;
+  args.xflags = 0;
+  args.fn = fn;
+  args.errfd = errpipe[1];
+
+  __libc_signal_block_all (&args.oldmask);
+
+  pid_t new_pid = __fork ();
+  if (new_pid == 0)
+    {
+      __close_nocancel (errpipe[0]);
+      __spawni_child (&args);
+    }
+  __close_nocancel (errpipe[1]);
+
+  /* The child closes its end once setup succeeded, or writes the error
+     number and exits.  All signals are blocked, so READ is not
+     interrupted.  */
+  if (new_pid < 0)
+    ec = errno;
+  else if (__read_nocancel (errpipe[0], &ec, sizeof (ec)) == sizeof (ec))
+    __waitpid (new_pid, NULL, 0);
+  else
+    ec = 0;
+  __close_nocancel (errpipe[0]);
+
+  if (ec == 0 && pid != NULL)
+    *pid = new_pid;
+  if (pidfd != NULL)
+    *pidfd = ec == 0 ? __pidfd_open (new_pid) : -1;
+
+  __libc_signal_restore_set (&args.oldmask);
+
+  __pthread_setcancelstate (state, NULL);
+
+  return ec;
+}
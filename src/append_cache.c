@@ -0,0 +1,121 @@
+/*
+ * Cache of descriptors for '>>' targets.
+ *
+ * There are only ever a few hot log files, so the entries are a small
+ * array searched linearly, with a use counter for LRU eviction.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "append_cache.h"
+
+/* Cached descriptors stay above the ones commands get dup2'd onto */
+#define FIRST_FD 10
+
+struct append_entry
+{
+    char *path;                 /* As written after '>>', NULL if unused */
+    int fd;
+    dev_t dev;                  /* Identity of the file fd refers to */
+    ino_t ino;
+    unsigned long uses;
+    unsigned long last_use;     /* Value of 'use_clock' when last used */
+};
+
+static struct append_entry entries[APPEND_CACHE_SIZE];
+static unsigned long use_clock;
+static unsigned long hits, misses, reopens;
+
+static void
+drop_entry(struct append_entry *e)
+{
+    close(e->fd);
+    free(e->path);
+    e->path = NULL;
+}
+
+int
+append_cache_get(const char *path)
+{
+    struct append_entry *e = NULL, *slot = &entries[0];
+    for (int i = 0; i < APPEND_CACHE_SIZE; i++)
+    {
+        if (entries[i].path && strcmp(entries[i].path, path) == 0)
+            e = &entries[i];
+        // pick an unused entry, or else the least recently used one
+        if (slot->path && (entries[i].path == NULL || entries[i].last_use < slot->last_use))
+            slot = &entries[i];
+    }
+
+    struct stat st;
+    if (e != NULL)
+    {
+        if (stat(path, &st) == 0 && st.st_dev == e->dev && st.st_ino == e->ino)
+        {
+            hits++;
+            e->uses++;
+            e->last_use = ++use_clock;
+            return e->fd;
+        }
+        // rotated, removed or, after a cd, a different file
+        drop_entry(e);
+        slot = e;
+        reopens++;
+    }
+    else
+        misses++;
+
+    // opening a FIFO could block the shell, so leave those to the child
+    if (stat(path, &st) == 0 && !S_ISREG(st.st_mode))
+        return -1;
+
+    int fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0666);
+    if (fd < 0)
+        return -1;
+    int high = fcntl(fd, F_DUPFD_CLOEXEC, FIRST_FD);
+    close(fd);
+    if (high < 0 || fstat(high, &st) != 0 || !S_ISREG(st.st_mode))
+    {
+        if (high >= 0)
+            close(high);
+        return -1;
+    }
+
+    if (slot->path)
+        drop_entry(slot);
+    *slot = (struct append_entry) {
+        .path = strdup(path),
+        .fd = high,
+        .dev = st.st_dev,
+        .ino = st.st_ino,
+        .uses = 1,
+        .last_use = ++use_clock,
+    };
+    return high;
+}
+
+void
+append_cache_clear(void)
+{
+    for (int i = 0; i < APPEND_CACHE_SIZE; i++)
+        if (entries[i].path)
+            drop_entry(&entries[i]);
+    hits = misses = reopens = 0;
+}
+
+void
+append_cache_print(void)
+{
+    size_t n = 0;
+    for (int i = 0; i < APPEND_CACHE_SIZE; i++)
+        n += entries[i].path != NULL;
+    printf("append cache: %lu hits, %lu misses, %lu reopens, %zu/%d files\n",
+           hits, misses, reopens, n, APPEND_CACHE_SIZE);
+    for (int i = 0; i < APPEND_CACHE_SIZE; i++)
+        if (entries[i].path)
+            printf("%4lu\t%s\n", entries[i].uses, entries[i].path);
+}
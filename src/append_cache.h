@@ -0,0 +1,31 @@
+#ifndef __APPEND_CACHE_H
+#define __APPEND_CACHE_H
+
+/*
+ * Descriptors kept open for '>>' targets.
+ *
+ * A shell that runs 'cmd >> log' over and over opens, creates if need
+ * be, and closes the same file every time.  With the cache on, the
+ * shell opens each target once with O_APPEND and hands the descriptor
+ * to every command that appends to it, which dup2s it onto its standard
+ * output.  Each use stats the path and compares (st_dev, st_ino) with
+ * the open file, so a log that was rotated or removed is opened afresh.
+ * Only regular files are kept; the least recently used one is closed
+ * when the cache is full.
+ */
+#define APPEND_CACHE_SIZE 16
+
+/* Return a descriptor open for appending to 'path', creating the file
+ * if it does not exist.  The descriptor belongs to the cache and is
+ * close-on-exec.  Returns -1 if 'path' is not a regular file or cannot
+ * be opened; the caller then opens it the usual way, which reports
+ * any error. */
+int append_cache_get(const char *path);
+
+/* Close every cached descriptor and reset the counters. */
+void append_cache_clear(void);
+
+/* Print the counters and the open targets, as 'appendcache' does. */
+void append_cache_print(void);
+
+#endif /* __APPEND_CACHE_H */
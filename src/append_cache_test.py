@@ -0,0 +1,58 @@
+#!/usr/bin/python
+#
+# append_cache_test: tests keeping >> targets open with appendcache
+#
+# Appends to files through the cached descriptors, and rotates one
+#
+
+import sys, imp, atexit, pexpect, proc_check, signal, time, threading
+from testutils import *
+import tempfile, shutil, os
+
+console = setup_tests()
+
+# ensure that shell prints expected prompt
+expect_prompt()
+
+tmpdir = tempfile.mkdtemp("-cush-append")
+atexit.register(lambda: shutil.rmtree(tmpdir))
+log = tmpdir + "/x.log"
+
+sendline("appendcache on")
+expect_prompt()
+
+# builtins and external commands share the descriptor
+sendline("echo one >> " + log)
+expect_prompt()
+sendline("/bin/echo two >> " + log)
+expect_prompt()
+sendline("/bin/echo three >> " + log)
+expect_prompt()
+sendline("appendcache")
+expect_exact("append cache: 2 hits, 1 misses, 0 reopens, 1/", "the file was not kept open")
+expect_prompt()
+
+# a rotated log is opened afresh
+sendline("mv %s %s.1" % (log, log))
+expect_prompt()
+sendline("/bin/echo four >> " + log)
+expect_prompt()
+sendline("cat %s.1 %s | rev" % (log, log))
+expect_exact("eno\r\nowt\r\neerht\r\nruof", "appends went to the wrong file")
+expect_prompt()
+
+# commands do not see the cached descriptors
+sendline("ls /proc/self/fd >> " + log)
+expect_prompt()
+sendline("wc -l < " + log)
+expect_exact("5", "a cached descriptor leaked into a command")
+expect_prompt()
+
+# off closes everything
+sendline("appendcache off")
+expect_prompt()
+sendline("appendcache")
+expect_exact("0/", "appendcache off did not close the files")
+expect_prompt()
+
+test_success()
@@ -0,0 +1,75 @@
+/*
+ * Reference counted bump allocator.
+ */
+#include <stdlib.h>
+#include <stdalign.h>
+#include <stdint.h>
+
+#include "arena.h"
+
+#define ALIGNMENT alignof(max_align_t)
+#define ALIGN_UP(n) (((n) + ALIGNMENT - 1) & ~(ALIGNMENT - 1))
+
+struct arena_chunk {
+    struct arena_chunk *next;
+    size_t size;
+    alignas(max_align_t) char data[];
+};
+
+/* The first chunk directly follows the arena in the same allocation. */
+#define ARENA_HEADER ALIGN_UP(sizeof(struct arena))
+
+struct arena *
+arena_create(size_t size)
+{
+    struct arena *arena = malloc(ARENA_HEADER + size);
+
+    arena->refcount = 1;
+    arena->next = (char *)arena + ARENA_HEADER;
+    arena->end = arena->next + size;
+    arena->chunks = NULL;
+    return arena;
+}
+
+void *
+arena_alloc(struct arena *arena, size_t size)
+{
+    size = ALIGN_UP(size);
+    if ((size_t)(arena->end - arena->next) < size) {
+        size_t prev = arena->chunks ? arena->chunks->size
+                                    : (size_t)(arena->end - (char *)arena);
+        size_t chunk_size = 2 * prev > size ? 2 * prev : size;
+        struct arena_chunk *chunk = malloc(sizeof *chunk + chunk_size);
+
+        chunk->size = chunk_size;
+        chunk->next = arena->chunks;
+        arena->chunks = chunk;
+        arena->next = chunk->data;
+        arena->end = chunk->data + chunk_size;
+    }
+
+    void *p = arena->next;
+    arena->next += size;
+    return p;
+}
+
+struct arena *
+arena_get(struct arena *arena)
+{
+    arena->refcount++;
+    return arena;
+}
+
+void
+arena_put(struct arena *arena)
+{
+    if (arena == NULL || --arena->refcount > 0)
+        return;
+
+    for (struct arena_chunk *chunk = arena->chunks; chunk != NULL; ) {
+        struct arena_chunk *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    free(arena);
+}
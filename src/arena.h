@@ -0,0 +1,37 @@
+#ifndef __ARENA_H
+#define __ARENA_H
+
+#include <stddef.h>
+
+/*
+ * A bump allocator for data that is freed all at once.
+ *
+ * The parser allocates everything it builds for one command line from
+ * one arena: the text of the line, the words, the argv arrays and the
+ * AST nodes.  Allocation just moves a pointer; when the first chunk is
+ * used up a larger one is chained on.  Nothing is freed individually.
+ *
+ * An arena is reference counted, so the pipelines of a command line can
+ * share it and it is released when the last of them is freed, e.g. when
+ * the job a pipeline became is deleted.
+ */
+struct arena_chunk;
+
+struct arena {
+    int refcount;                 /* owners; released when this drops to 0 */
+    char *next;                   /* free space in the current chunk */
+    char *end;
+    struct arena_chunk *chunks;   /* chunks chained on after the first */
+};
+
+/* Create an arena whose first chunk holds 'size' bytes, with one reference. */
+struct arena *arena_create(size_t size);
+
+/* Allocate 'size' bytes, suitably aligned for any type. */
+void *arena_alloc(struct arena *arena, size_t size);
+
+/* Take and drop a reference.  Dropping the last one frees the arena. */
+struct arena *arena_get(struct arena *arena);
+void arena_put(struct arena *arena);
+
+#endif /* __ARENA_H */
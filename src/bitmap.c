@@ -0,0 +1,84 @@
+/*
+ * Hierarchical bitmap used to allocate the smallest free id.
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "bitmap.h"
+
+#define WORD_BITS 64
+#define FULL_WORD (~(uint64_t)0)
+
+void
+bitmap_init(struct bitmap *b)
+{
+    memset(b, 0, sizeof *b);
+}
+
+void
+bitmap_destroy(struct bitmap *b)
+{
+    for (int l = 0; l < BITMAP_LEVELS; l++)
+        free(b->words[l]);
+    bitmap_init(b);
+}
+
+void
+bitmap_grow(struct bitmap *b, size_t capacity)
+{
+    if (capacity <= b->capacity)
+        return;
+
+    size_t n = (capacity + WORD_BITS - 1) / WORD_BITS;
+    for (int l = 0; l < BITMAP_LEVELS; l++) {
+        if (n > b->nwords[l]) {
+            b->words[l] = realloc(b->words[l], n * sizeof(uint64_t));
+            memset(b->words[l] + b->nwords[l], 0,
+                   (n - b->nwords[l]) * sizeof(uint64_t));
+            b->nwords[l] = n;
+        }
+        n = (n + WORD_BITS - 1) / WORD_BITS;
+    }
+    b->capacity = capacity;
+}
+
+size_t
+bitmap_first_clear(const struct bitmap *b)
+{
+    int top = BITMAP_LEVELS - 1;
+    size_t idx = 0;
+
+    /* The top level has a single word unless the bitmap is huge. */
+    while (idx < b->nwords[top] && b->words[top][idx] == FULL_WORD)
+        idx++;
+    if (idx == b->nwords[top])
+        return b->capacity;
+
+    for (int l = top; l >= 0; l--) {
+        if (idx >= b->nwords[l])
+            return b->capacity;
+        idx = idx * WORD_BITS + __builtin_ctzll(~b->words[l][idx]);
+    }
+    return idx < b->capacity ? idx : b->capacity;
+}
+
+void
+bitmap_set(struct bitmap *b, size_t id)
+{
+    for (int l = 0; l < BITMAP_LEVELS; l++) {
+        uint64_t *w = &b->words[l][id / WORD_BITS];
+        *w |= (uint64_t)1 << (id % WORD_BITS);
+        if (*w != FULL_WORD)
+            break;
+        id /= WORD_BITS;
+    }
+}
+
+void
+bitmap_clear(struct bitmap *b, size_t id)
+{
+    for (int l = 0; l < BITMAP_LEVELS; l++) {
+        b->words[l][id / WORD_BITS] &= ~((uint64_t)1 << (id % WORD_BITS));
+        id /= WORD_BITS;
+    }
+}
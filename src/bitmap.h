@@ -0,0 +1,39 @@
+#ifndef __BITMAP_H
+#define __BITMAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * A growable, hierarchical bitmap for handing out small integer ids.
+ *
+ * Level 0 has one bit per id, set while the id is in use.  Each higher
+ * level has one bit per word of the level below, set while that word is
+ * full.  Finding the lowest clear bit therefore takes one find-first-set
+ * per level rather than a scan over all ids.
+ */
+#define BITMAP_LEVELS 4     /* enough for 64^4 ids */
+
+struct bitmap {
+    uint64_t *words[BITMAP_LEVELS];   /* words[0] is the id level */
+    size_t nwords[BITMAP_LEVELS];     /* number of words per level */
+    size_t capacity;                  /* number of ids covered */
+};
+
+/* Initialize an empty bitmap that covers no ids. */
+void bitmap_init(struct bitmap *b);
+
+/* Release the memory held by the bitmap. */
+void bitmap_destroy(struct bitmap *b);
+
+/* Extend the bitmap to cover at least 'capacity' ids. New ids are clear. */
+void bitmap_grow(struct bitmap *b, size_t capacity);
+
+/* Return the lowest clear id, or b->capacity if every id is set. */
+size_t bitmap_first_clear(const struct bitmap *b);
+
+/* Mark id as used/unused.  id must be below b->capacity. */
+void bitmap_set(struct bitmap *b, size_t id);
+void bitmap_clear(struct bitmap *b, size_t id);
+
+#endif /* __BITMAP_H */
@@ -0,0 +1,66 @@
+#!/usr/bin/python
+#
+# builtin_pipe_test: tests builtins in pipelines and with redirection
+#
+# Test that builtins can write to a file or a pipe, and that a builtin
+# at the end of a pipeline still runs
+#
+
+import sys, imp, atexit, os, pexpect, proc_check, signal, time, threading
+from testutils import *
+
+console = setup_tests()
+
+# ensure that shell prints expected prompt
+expect_prompt()
+
+outfile = "/tmp/cush_builtin_pipe_%d.txt" % os.getpid()
+atexit.register(lambda: os.path.exists(outfile) and os.unlink(outfile))
+
+# start a job for the builtins to report
+sendline("sleep 100 &")
+(jobid, pid) = parse_bg_status()
+expect_prompt()
+
+# output redirection of a builtin
+sendline("jobs > " + outfile)
+expect_prompt()
+sendline("cat " + outfile)
+expect_exact("(sleep 100)", "jobs did not write to the output file")
+
+# appending
+sendline("jobs >> " + outfile)
+expect_prompt()
+sendline("wc -l < " + outfile)
+expect_exact("2", "jobs did not append to the output file")
+
+# a builtin as the first stage of a pipeline
+sendline("jobs | rev")
+expect_exact(")001 peels(", "jobs did not write into the pipe")
+
+sendline("history | grep rev")
+expect_exact("jobs | rev", "history did not write into the pipe")
+
+# a builtin as the last stage of a pipeline runs in the shell
+sendline("echo first | jobs")
+expect_exact("(sleep 100)", "jobs at the end of a pipeline did not run")
+
+# builtins that change the shell cannot feed a pipe
+sendline("cd / | cat")
+expect_exact("cd: cannot be used in a pipeline", "expected an error for cd")
+
+# job control builtins insist on a job id
+sendline("fg")
+expect_exact("fg: usage: fg JOB_ID", "expected a usage message for fg")
+sendline("kill x1")
+expect_exact("kill: usage: kill JOB_ID", "expected a usage message for kill")
+
+# clean up the job
+run_builtin('kill', jobid)
+expect_prompt()
+
+#exit
+sendline("exit")
+expect_exact("exit\r\n", "Shell output extraneous characters")
+
+test_success()
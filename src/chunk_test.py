@@ -0,0 +1,81 @@
+#!/usr/bin/python
+#
+# chunk_test: tests running an oversized argument list in batches
+#
+# Splits a list of files too long for one execve into batches
+#
+
+import sys, imp, atexit, pexpect, proc_check, signal, time, threading
+from testutils import *
+import tempfile, shutil, os
+
+console = setup_tests()
+
+# ensure that shell prints expected prompt
+expect_prompt()
+
+tmpdir = tempfile.mkdtemp("-cush-chunk")
+atexit.register(lambda: shutil.rmtree(tmpdir))
+
+# enough files that their names do not fit into one execve
+namelen = 100
+nfiles = os.sysconf('SC_ARG_MAX') // namelen + 1000
+for i in range(nfiles):
+    open("%s/%08d_%s" % (tmpdir, i, "x" * (namelen - 10)), "w")
+
+sendline("cd " + tmpdir)
+expect_prompt()
+sendline("/bin/echo * > ../cush_chunk_out_%d || echo too_long | rev" % os.getpid())
+expect_exact("gnol_oot", "the argument list was expected to be too long")
+expect_prompt()
+
+# chunk splits it, and > is truncated once for all batches
+out = "/tmp/cush_chunk_%d" % os.getpid()
+atexit.register(lambda: os.path.exists(out) and os.unlink(out))
+sendline("chunk /bin/echo * > " + out)
+expect_prompt()
+sendline("wc -w < " + out)
+expect_exact("%d" % nfiles, "chunk lost arguments")
+expect_prompt()
+assert len(open(out).readlines()) > 1, "chunk did not split the arguments"
+
+# the command and everything up to -- is repeated in each batch
+sendline("chunk -n 2 /bin/echo pre -- a b c | cat")
+expect_exact("cannot be used in a pipeline", "chunk was accepted in a pipeline")
+expect_prompt()
+sendline("chunk -n 2 /bin/echo pre -- a b c > " + out)
+expect_prompt()
+sendline("cat " + out + " | rev")
+expect_exact("b a -- erp\r\nc -- erp", "chunk did not repeat the fixed arguments")
+expect_prompt()
+
+# the status is that of the first batch that failed
+sendline("chunk -n 1 ls -d -- 00000000* nothing 00000001*; echo status_$?")
+expect_exact("status_2", "chunk did not report a failed batch")
+expect_prompt()
+
+# parallel batches form one job, which jobs, fg and kill handle as a whole
+sendline("chunk -n 1 -P 2 sleep 1000 1000 1000 &")
+(jobid, pid) = parse_bg_status()
+expect_prompt()
+sendline("jobs")
+expect_exact("[%s]" % jobid, "jobs did not list the chunked job")
+expect_prompt()
+sendline("jobs | wc -l | sed s/1/one_job/")
+expect_exact("one_job", "the batches were listed as several jobs")
+expect_prompt()
+sendline("kill " + jobid)
+expect_prompt()
+time.sleep(0.5)
+sendline("jobs")
+expect_prompt()
+assert "sleep" not in console.before, "kill did not end the chunked job"
+
+sendline("chunk -n 1 sleep 0.5 0.5 0.5 &")
+(jobid, pid) = parse_bg_status()
+expect_prompt()
+sendline("fg " + jobid)
+expect_exact("chunk -n 1 sleep", "fg did not print the job")
+expect_prompt("the chunked job did not finish in the foreground")
+
+test_success()
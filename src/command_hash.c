@@ -0,0 +1,252 @@
+/*
+ * Remembered command locations.
+ *
+ * A small chained hash table mapping command names to the absolute
+ * path they resolved to on $PATH (or to NULL if they were not found).
+ * This lets the shell spawn with posix_spawn() on a known path instead
+ * of letting the child try execve() on every $PATH entry in turn.
+ */
+#define _GNU_SOURCE 1
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "command_hash.h"
+#include "variables.h"
+
+struct command_entry
+{
+    struct command_entry *next; /* Next entry in the same bucket */
+    char *name;                 /* Command name as typed */
+    char *path;                 /* Absolute path, or NULL for a cached miss */
+    int hits;                   /* Number of times this entry was used */
+};
+
+#define INITIAL_BUCKETS 64
+
+static struct command_entry **buckets;
+static size_t nbuckets;
+static size_t nentries;
+static char *hashed_path; /* Value of $PATH the table was built for */
+
+/* FNV-1a */
+static uint32_t
+hash_name(const char *name)
+{
+    uint32_t h = 2166136261u;
+    while (*name)
+    {
+        h ^= (unsigned char)*name++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static struct command_entry **
+find_slot(const char *name)
+{
+    if (buckets == NULL)
+        return NULL;
+
+    struct command_entry **pe = &buckets[hash_name(name) & (nbuckets - 1)];
+    while (*pe && strcmp((*pe)->name, name) != 0)
+        pe = &(*pe)->next;
+    return pe;
+}
+
+static void
+free_entry(struct command_entry *e)
+{
+    free(e->name);
+    free(e->path);
+    free(e);
+}
+
+/* Double the bucket array once the load factor exceeds 3/4 */
+static void
+maybe_grow(void)
+{
+    if (buckets != NULL && nentries * 4 < nbuckets * 3)
+        return;
+
+    size_t newsize = buckets ? nbuckets * 2 : INITIAL_BUCKETS;
+    struct command_entry **newbuckets = calloc(newsize, sizeof *newbuckets);
+    for (size_t i = 0; i < nbuckets; i++)
+    {
+        for (struct command_entry *e = buckets[i], *next; e; e = next)
+        {
+            next = e->next;
+            struct command_entry **b = &newbuckets[hash_name(e->name) & (newsize - 1)];
+            e->next = *b;
+            *b = e;
+        }
+    }
+    free(buckets);
+    buckets = newbuckets;
+    nbuckets = newsize;
+}
+
+static struct command_entry *
+add_entry(const char *name, char *path)
+{
+    maybe_grow();
+    struct command_entry *e = malloc(sizeof *e);
+    struct command_entry **b = &buckets[hash_name(name) & (nbuckets - 1)];
+    e->name = strdup(name);
+    e->path = path;
+    e->hits = 0;
+    e->next = *b;
+    *b = e;
+    nentries++;
+    return e;
+}
+
+/* Return the current search path, using the same default as execvp */
+static const char *
+current_path(void)
+{
+    const char *path = variables_get("PATH");
+    return path ? path : "/bin:/usr/bin";
+}
+
+/* Drop the table if $PATH changed since it was built */
+static void
+check_path(void)
+{
+    const char *path = current_path();
+    if (hashed_path && strcmp(hashed_path, path) == 0)
+        return;
+
+    command_hash_clear();
+    free(hashed_path);
+    hashed_path = strdup(path);
+}
+
+/* Walk $PATH looking for an executable regular file called 'name'.
+ * Sets *cacheable to false if the result depends on the current
+ * directory (relative or empty $PATH entries). */
+static char *
+search_path(const char *name, bool *cacheable)
+{
+    const char *p = current_path();
+    size_t namelen = strlen(name);
+    *cacheable = true;
+
+    for (;;)
+    {
+        const char *end = strchrnul(p, ':');
+        size_t dirlen = end - p;
+        char buf[dirlen + namelen + 3];
+
+        if (dirlen == 0)
+            strcpy(buf, "./");
+        else
+        {
+            memcpy(buf, p, dirlen);
+            buf[dirlen] = '/';
+            buf[dirlen + 1] = '\0';
+        }
+        strcat(buf, name);
+
+        bool relative = buf[0] != '/';
+        struct stat st;
+        if (stat(buf, &st) == 0 && S_ISREG(st.st_mode) && access(buf, X_OK) == 0)
+        {
+            *cacheable = !relative;
+            return strdup(buf);
+        }
+        if (relative)
+            *cacheable = false;
+
+        if (*end == '\0')
+            return NULL;
+        p = end + 1;
+    }
+}
+
+const char *
+command_hash_lookup(const char *name)
+{
+    check_path();
+
+    struct command_entry **pe = find_slot(name);
+    if (pe && *pe)
+    {
+        (*pe)->hits++;
+        return (*pe)->path;
+    }
+
+    bool cacheable;
+    char *path = search_path(name, &cacheable);
+    if (!cacheable)
+    {
+        /* Not remembered; hand out a copy that lives until the next call */
+        static char *uncached;
+        free(uncached);
+        uncached = path;
+        return path;
+    }
+
+    struct command_entry *e = add_entry(name, path);
+    e->hits++;
+    return e->path;
+}
+
+void
+command_hash_remove(const char *name)
+{
+    struct command_entry **pe = find_slot(name);
+    if (pe && *pe)
+    {
+        struct command_entry *e = *pe;
+        *pe = e->next;
+        free_entry(e);
+        nentries--;
+    }
+}
+
+void
+command_hash_clear(void)
+{
+    for (size_t i = 0; i < nbuckets; i++)
+    {
+        for (struct command_entry *e = buckets[i], *next; e; e = next)
+        {
+            next = e->next;
+            free_entry(e);
+        }
+        buckets[i] = NULL;
+    }
+    nentries = 0;
+}
+
+void
+command_hash_insert(const char *name, const char *path)
+{
+    check_path();
+    command_hash_remove(name);
+    add_entry(name, strdup(path));
+}
+
+void
+command_hash_print(void)
+{
+    bool any = false;
+    for (size_t i = 0; i < nbuckets; i++)
+    {
+        for (struct command_entry *e = buckets[i]; e; e = e->next)
+        {
+            if (e->path == NULL)
+                continue;
+            if (!any)
+                printf("hits\tcommand\n");
+            any = true;
+            printf("%4d\t%s\n", e->hits, e->path);
+        }
+    }
+    if (!any)
+        printf("hash: hash table empty\n");
+}
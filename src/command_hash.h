@@ -0,0 +1,32 @@
+#ifndef __COMMAND_HASH_H
+#define __COMMAND_HASH_H
+
+#include <stdbool.h>
+
+/*
+ * Remembered locations of commands, in the style of bash's 'hash'.
+ *
+ * A command name is resolved against $PATH once, and later spawns
+ * use the absolute path directly.  Misses are cached too, so a
+ * mistyped command does not walk $PATH again.  The whole table is
+ * discarded whenever $PATH changes.
+ */
+
+/* Return the absolute path for 'name', or NULL if it cannot be found
+ * on $PATH.  'name' must not contain a '/'.  The result is owned by
+ * the table and is valid until the next call into this module. */
+const char *command_hash_lookup(const char *name);
+
+/* Forget a single entry, e.g. after the cached file vanished. */
+void command_hash_remove(const char *name);
+
+/* Forget all remembered locations ('hash -r'). */
+void command_hash_clear(void);
+
+/* Remember 'path' as the location of 'name' ('hash -p path name'). */
+void command_hash_insert(const char *name, const char *path);
+
+/* Print the table with hit counts, as the 'hash' builtin does. */
+void command_hash_print(void);
+
+#endif /* __COMMAND_HASH_H */
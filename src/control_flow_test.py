@@ -0,0 +1,107 @@
+#!/usr/bin/python
+#
+# control_flow_test: tests if, while, for, && and ||
+#
+# Runs branches, loops and && || chains, and interrupts loops with ^C and ^Z
+#
+
+import sys, imp, atexit, os, pexpect, proc_check, signal, time, threading
+from testutils import *
+
+console = setup_tests()
+
+# ensure that shell prints expected prompt
+expect_prompt()
+
+flagfile = "/tmp/cush_control_flow_%d" % os.getpid()
+atexit.register(lambda: os.path.exists(flagfile) and os.unlink(flagfile))
+
+# if takes the branch its condition selects
+sendline('if test -d /; then printf "%s_%s\\n" then branch; else printf "%s_%s\\n" else branch; fi')
+expect_exact("then_branch", "if did not run its then branch")
+expect_prompt()
+assert "else_branch" not in console.before, "if ran its else branch too"
+
+sendline('if false; then echo no; elif true; then printf "%s_%s\\n" elif branch; fi')
+expect_exact("elif_branch", "elif did not run")
+expect_prompt()
+
+# && and || test the status of the pipeline before them
+sendline('false || printf "%s_%s\\n" or ran; true && printf "%s_%s\\n" and ran')
+expect_exact("or_ran", "|| did not run after a failure")
+expect_exact("and_ran", "&& did not run after a success")
+expect_prompt()
+
+# a branch that is not taken does not run anything
+sendline('true || /no/such/command')
+expect_prompt()
+assert "/no/such/command:" not in console.before, "skipped command was started"
+
+# the status of a pipeline is that of its last command
+sendline('false | true && printf "%s_%s\\n" last command')
+expect_exact("last_command", "pipeline status is not that of its last command")
+expect_prompt()
+
+# for sets the loop variable
+sendline('for v in one two three; do echo $v; done')
+expect_exact("one\r\ntwo\r\nthree\r\n", "for did not iterate over its words")
+expect_prompt()
+
+# while loops until its condition fails
+sendline('while test ! -e %s; do touch %s; printf "%%s_%%s\\n" loop body; done' % (flagfile, flagfile))
+expect_exact("loop_body", "while did not run its body")
+expect_prompt()
+assert "loop_body" not in console.before, "while ran its body more than once"
+
+# reserved words are ordinary words after the command name
+sendline('echo if then fi do done | rev')
+expect_exact("enod od if neht fi", "reserved words were not passed as arguments")
+expect_prompt()
+
+# a command that is not complete continues on the next line
+sendline('if false')
+expect_exact("> ", "expected a continuation prompt")
+sendline('then echo no')
+expect_exact("> ", "expected a continuation prompt")
+sendline('else printf "%s_%s\\n" second line')
+expect_exact("> ", "expected a continuation prompt")
+sendline('fi')
+expect_exact("second_line", "multi-line if did not run")
+expect_prompt()
+
+# interrupting a command in a loop ends the loop
+sendline('while true; do sleep 10; done')
+time.sleep(0.5)
+sendintr()
+expect_prompt("loop did not stop after ^C")
+
+# a loop of builtins runs in the shell itself: ^C and ^Z end the loop,
+# not the shell
+sendline('while true; do x=1; done')
+time.sleep(0.5)
+sendintr()
+expect_prompt("builtin loop did not stop after ^C")
+sendline('echo status_$?')
+expect_exact("status_130", "interrupted loop did not set the status")
+expect_prompt()
+sendline('while true; do x=1; done')
+time.sleep(0.5)
+sendcontrol('z')
+expect_prompt("builtin loop did not stop after ^Z")
+sendline('printf "%s_%s\\n" still alive')
+expect_exact("still_alive", "shell did not survive ^C and ^Z")
+expect_prompt()
+
+# errors are reported
+sendline('fi')
+expect_exact("Syntax error.", "expected a syntax error")
+expect_prompt()
+sendline('for 1x in a; do echo; done')
+expect_exact("Illegal variable name.", "expected an error for a bad loop variable")
+expect_prompt()
+
+#exit
+sendline("exit")
+expect_exact("exit\r\n", "Shell output extraneous characters")
+
+test_success()
@@ -16,6 +16,13 @@
 #include <assert.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <time.h>
+#include <poll.h>
+#include <sys/signalfd.h>
+#include <sys/pidfd.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <limits.h>
 
 /* Since the handed out code contains a number of unused functions. */
 #pragma GCC diagnostic ignored "-Wunused-function"
@@ -26,25 +33,80 @@
 #include "utils.h"
 #include "spawn.h"
 #include "list.h"
+#include "command_hash.h"
+#include "bitmap.h"
+#include "utility_builtins.h"
+#include "parse_cache.h"
+#include "script.h"
+#include "script_cache.h"
+#include "variables.h"
+#include "glob_expand.h"
+#include "append_cache.h"
 extern char **environ;
 static void handle_child_status(pid_t pid, int status);
-static void exe_pipelines(struct ast_pipeline *pipee);
-static void non_built_in(struct ast_pipeline *pipee, struct ast_command *command);
+static int exe_pipelines(struct ast_pipeline *pipee);
+static void handle_line(char *cmdline);
+static void eval_command_line(char *cmdline);
+static void run_command_line(struct ast_command_line *cline);
+static int non_built_in(struct ast_pipeline *pipee);
+static int run_chunked(struct ast_pipeline *pipee);
+
+/* Default limit on job ids, which run from 1 to MAXJOBS - 1 */
+#define MAXJOBS (1 << 16)
 
 static void usage(char *progname)
 {
-    printf("Usage: %s -h\n"
-           " -h            print this help\n",
-           progname);
+    printf("Usage: %s [options] [script | -c command]\n"
+           " -a            keep files appended to with >> open, see appendcache\n"
+           " -c command    run command instead of reading from the terminal\n"
+           " -h            print this help\n"
+           " -j maxjobs    allow at most maxjobs jobs at a time (default %d)\n"
+           " -R njobs      start njobs background jobs, report reap latency and exit\n"
+           " -x            run echo, printf, true, false and test as external programs\n",
+           progname, MAXJOBS - 1);
 
     exit(EXIT_SUCCESS);
 }
 
+/* The start of a command that continues on the next line, see eval_command_line */
+static char *continued_line;
+static size_t continued_len, continued_size;
+
+/* Add a line to the text of the command it continues, which goes into
+ * the history as a whole */
+static void append_continued_line(const char *line)
+{
+    size_t len = strlen(line);
+    size_t sep = continued_line != NULL; // the newline between the lines
+    if (continued_len + sep + len + 1 > continued_size)
+    {
+        continued_size = 2 * (continued_len + sep + len + 1);
+        continued_line = realloc(continued_line, continued_size);
+        if (continued_line == NULL)
+        {
+            utils_fatal_error("out of memory");
+        }
+    }
+    if (sep)
+    {
+        continued_line[continued_len++] = '\n';
+    }
+    memcpy(continued_line + continued_len, line, len + 1);
+    continued_len += len;
+}
+
+static void end_continued_line(void)
+{
+    free(continued_line);
+    continued_line = NULL;
+    continued_len = continued_size = 0;
+}
+
 /* Build a prompt */
 static char *
 build_prompt(void)
 {
-    return strdup("cush> ");
+    return strdup(continued_line ? "> " : "cush> ");
 }
 
 enum job_status
@@ -72,18 +134,30 @@ struct job
 
     /* Add additional fields here if needed. */
     struct PIDs *PID_list; // list of PIDs that a job has
+    pid_t last_pid;        // process of the pipeline's last command, or -1
+    int last_status;       // its exit status, once it has terminated
+    struct chunks *chunks; // batches still to run for chunk, or NULL
 };
 
+static void run_chunks(struct job *job);
+static void free_chunks(struct chunks *chunks);
+
 /**
  * Struct for an array of PID that a job has
  */
 struct PIDs
 {
     pid_t *data;      // array of PID
+    int *pidfds;      // pidfd per PID, -1 without one, PID_REAPED once reaped
+    bool have_pidfds; // false if any process was spawned without a pidfd
     size_t size;      // max amount of PID
     size_t curr_size; // number of PID
 };
 
+/* Marks the slot of a reaped process, whose PID may have been reused.
+ * Neither 0 nor -1, which kill() would take for a whole group. */
+#define PID_REAPED (-2)
+
 static void print_PIDs(struct PIDs *const pPIDs)
 {
     printf("THE PIDS ARE\n");
@@ -103,82 +177,303 @@ static struct PIDs *create_PIDs(size_t cap)
     pPIDs->size = cap;
     pPIDs->curr_size = 0;
     pPIDs->data = calloc(cap + 1, sizeof(pid_t));
+    pPIDs->pidfds = calloc(cap + 1, sizeof(int));
+    pPIDs->have_pidfds = true;
 
     return pPIDs;
 }
 
+/* Index from pid to the job (and slot in its PID list) that owns it,
+ * so that handle_child_status does not need to scan every job.
+ * Open addressing with linear probing; pid 0 marks an empty entry.
+ */
+struct pid_entry
+{
+    pid_t pid;       // key, 0 if unused
+    struct job *job; // job the process belongs to
+    size_t slot;     // index into job->PID_list->data
+};
+
+static struct pid_entry *pid_index;
+static size_t pid_index_cap;  // always a power of 2
+static size_t pid_index_used; // number of entries in use
+
+static size_t pid_index_home(pid_t pid)
+{
+    return ((uint32_t)pid * 2654435761u) & (pid_index_cap - 1);
+}
+
+static void pid_index_put(pid_t pid, struct job *job, size_t slot);
+
+/* Double the table once it is half full */
+static void pid_index_grow(void)
+{
+    struct pid_entry *old = pid_index;
+    size_t oldcap = pid_index_cap;
+
+    pid_index_cap = oldcap ? oldcap * 2 : 64;
+    pid_index = calloc(pid_index_cap, sizeof *pid_index);
+    pid_index_used = 0;
+    for (size_t i = 0; i < oldcap; i++)
+    {
+        if (old[i].pid != 0)
+        {
+            pid_index_put(old[i].pid, old[i].job, old[i].slot);
+        }
+    }
+    free(old);
+}
+
+static void pid_index_put(pid_t pid, struct job *job, size_t slot)
+{
+    if ((pid_index_used + 1) * 2 > pid_index_cap)
+    {
+        pid_index_grow();
+    }
+
+    size_t i = pid_index_home(pid);
+    while (pid_index[i].pid != 0 && pid_index[i].pid != pid)
+    {
+        i = (i + 1) & (pid_index_cap - 1);
+    }
+    if (pid_index[i].pid == 0)
+    {
+        pid_index_used++;
+    }
+    pid_index[i] = (struct pid_entry){.pid = pid, .job = job, .slot = slot};
+}
+
+static struct pid_entry *pid_index_find(pid_t pid)
+{
+    if (pid_index_cap == 0)
+    {
+        return NULL;
+    }
+
+    for (size_t i = pid_index_home(pid); pid_index[i].pid != 0; i = (i + 1) & (pid_index_cap - 1))
+    {
+        if (pid_index[i].pid == pid)
+        {
+            return &pid_index[i];
+        }
+    }
+    return NULL;
+}
+
+/* Remove the entry for pid if it still belongs to job.
+ * Uses backward-shift deletion so lookups never see tombstones.
+ */
+static void pid_index_remove(pid_t pid, struct job *job)
+{
+    struct pid_entry *e = pid_index_find(pid);
+    if (e == NULL || e->job != job)
+    {
+        return;
+    }
+
+    size_t i = e - pid_index;
+    size_t j = i;
+    for (;;)
+    {
+        j = (j + 1) & (pid_index_cap - 1);
+        if (pid_index[j].pid == 0)
+        {
+            break;
+        }
+        // move j back into the hole at i unless its home lies cyclically in (i, j]
+        size_t home = pid_index_home(pid_index[j].pid);
+        if ((j > i && (home <= i || home > j)) || (j < i && (home <= i && home > j)))
+        {
+            pid_index[i] = pid_index[j];
+            i = j;
+        }
+    }
+    pid_index[i].pid = 0;
+    pid_index_used--;
+}
+
 /**
- * Add a pid to a PID List
+ * Add a pid to a job's PID List
+ * The list grows for a chunked job, which starts its batches one by one.
  */
-static void add_PID(struct PIDs *const pPIDs, pid_t pid)
+static void add_PID(struct job *job, pid_t pid, int pidfd)
 {
-    // printf("ADDING A NEW PID at index %ld   %d\n", pPIDs->curr_size, pid);
+    struct PIDs *const pPIDs = job->PID_list;
+    if (pPIDs->curr_size == pPIDs->size)
+    {
+        pPIDs->size *= 2;
+        pPIDs->data = realloc(pPIDs->data, (pPIDs->size + 1) * sizeof(pid_t));
+        pPIDs->pidfds = realloc(pPIDs->pidfds, (pPIDs->size + 1) * sizeof(int));
+        if (pPIDs->data == NULL || pPIDs->pidfds == NULL)
+        {
+            utils_fatal_error("out of memory");
+        }
+    }
     pPIDs->data[pPIDs->curr_size] = pid;
+    pPIDs->pidfds[pPIDs->curr_size] = pidfd;
+    if (pidfd < 0)
+    {
+        pPIDs->have_pidfds = false;
+    }
+    pid_index_put(pid, job, pPIDs->curr_size);
     pPIDs->curr_size++;
-    // printf("RESULT at index %ld   %d\n", pPIDs->curr_size - 1, pPIDs->data[pPIDs->curr_size - 1]);
 }
 
 /**
- * See if a PID is in the PID List
+ * Mark the slot of a process that has been reaped, closing its pidfd
+ */
+static void mark_reaped(struct PIDs *const pPIDs, size_t slot)
+{
+    if (pPIDs->pidfds[slot] >= 0)
+    {
+        close(pPIDs->pidfds[slot]);
+    }
+    pPIDs->pidfds[slot] = PID_REAPED;
+}
+
+/**
+ * Clean the PID
  */
-static bool find_PID(struct PIDs *const pPIDs, pid_t pid)
+static void clean_PID(struct PIDs *const pPIDs)
 {
     for (size_t i = 0; i < pPIDs->curr_size; i++)
     {
-        if (pPIDs->data[i] == pid)
+        if (pPIDs->pidfds[i] >= 0)
         {
-            return true;
+            close(pPIDs->pidfds[i]);
         }
     }
+    free(pPIDs->pidfds);
+    free(pPIDs->data);
+    free(pPIDs);
+}
+
+/* Run echo, printf, true, false and test as external programs (-x) */
+static bool external_utilities;
+
+/* Take '>>' targets from the append cache (-a, appendcache on) */
+static bool cache_appends;
+
+/* Reading commands from the terminal, with job control.  False when
+ * running a script or -c: then jobs stay in the shell's process group
+ * and never take the terminal, and there is no history. */
+static bool interactive = true;
 
+/* Exit status of the last pipeline, which && || if and while test, and $? */
+static int last_status;
+
+/* A foreground job was stopped or interrupted; stop running the line */
+static bool interrupted;
+
+/* True if the job's process group leader has not been reaped yet, as
+ * its pidfd shows, so the pgid cannot have been recycled */
+static bool job_leader_alive(struct job *job)
+{
+    struct PIDs *const pPIDs = job->PID_list;
+    for (size_t i = 0; i < pPIDs->curr_size; i++)
+    {
+        if (pPIDs->data[i] == job->pgid)
+        {
+            return pPIDs->pidfds[i] >= 0;
+        }
+    }
     return false;
 }
+
 /**
- * Clean the PID
+ * Send a signal to every process of a job.
+ * With job control the signal goes to the job's process group, which
+ * also reaches processes the job's commands started themselves.  The
+ * pidfds only tell whether that is safe: once the group leader has been
+ * reaped its pgid may belong to someone else, and the processes the
+ * shell started are signaled through their pidfds instead.
  */
-static void clean_PID(struct PIDs *const pPIDs)
+static int signal_job(struct job *job, int sig)
 {
-    free(pPIDs->data);
-    free(pPIDs);
+    struct PIDs *const pPIDs = job->PID_list;
+    if (interactive && (!pPIDs->have_pidfds || job_leader_alive(job)))
+    {
+        return killpg(job->pgid, sig);
+    }
+    if (!pPIDs->have_pidfds)
+    {
+        // without job control the job has no process group of its own;
+        // a reaped process's PID may belong to someone else by now
+        int rc = 0;
+        for (size_t i = 0; i < pPIDs->curr_size; i++)
+        {
+            if (pPIDs->pidfds[i] != PID_REAPED && kill(pPIDs->data[i], sig) == -1 && errno != ESRCH)
+            {
+                rc = -1;
+            }
+        }
+        return rc;
+    }
+
+    int rc = 0;
+    for (size_t i = 0; i < pPIDs->curr_size; i++)
+    {
+        // ESRCH: the process exited but has not been reaped yet
+        if (pPIDs->pidfds[i] >= 0 && pidfd_send_signal(pPIDs->pidfds[i], sig, NULL, 0) == -1 && errno != ESRCH)
+        {
+            rc = -1;
+        }
+    }
+    return rc;
 }
 
 /* Utility functions for job list management.
- * We use 2 data structures:
- * (a) an array jid2job to quickly find a job based on its id
- * (b) a linked list to support iteration
+ * We use 3 data structures:
+ * (a) a growable array jid2job to quickly find a job based on its id
+ * (b) a hierarchical bitmap of jids in use, to find the smallest free jid
+ * (c) a linked list to support iteration
  */
-#define MAXJOBS (1 << 16)
+static int max_jobs = MAXJOBS; // one past the largest jid, see -j
 static struct list job_list;
 
-static struct job *jid2job[MAXJOBS];
+static struct job **jid2job;
+static size_t jid2job_cap;
+static struct bitmap jid_bitmap;
 
 /* Return job corresponding to jid */
 static struct job *get_job_from_jid(int jid)
 {
-    if (jid > 0 && jid < MAXJOBS && jid2job[jid] != NULL)
+    if (jid > 0 && (size_t)jid < jid2job_cap && jid2job[jid] != NULL)
         return jid2job[jid];
     return NULL;
 }
 
-/* Add a new job to the job list */
+/* Add a new job to the job list.
+ * Returns NULL if max_jobs jobs already exist.
+ */
 static struct job *add_job(struct ast_pipeline *pipe)
 {
+    size_t jid = bitmap_first_clear(&jid_bitmap);
+    if (jid >= (size_t)max_jobs)
+    {
+        fprintf(stderr, "Maximum number of jobs exceeded\n");
+        return NULL;
+    }
+    if (jid >= jid2job_cap)
+    {
+        size_t cap = jid2job_cap ? jid2job_cap * 2 : 64;
+        jid2job = realloc(jid2job, cap * sizeof *jid2job);
+        memset(jid2job + jid2job_cap, 0, (cap - jid2job_cap) * sizeof *jid2job);
+        jid2job_cap = cap;
+        bitmap_grow(&jid_bitmap, cap);
+    }
+
     struct job *job = malloc(sizeof *job);
-    job->pipe = pipe;
+    job->pipe = ast_pipeline_get(pipe);
     job->num_processes_alive = 0;
+    job->last_pid = -1;
+    job->last_status = 0;
+    job->chunks = NULL;
+    job->jid = jid;
+    jid2job[jid] = job;
+    bitmap_set(&jid_bitmap, jid);
     list_push_back(&job_list, &job->elem);
-    for (int i = 1; i < MAXJOBS; i++)
-    {
-        if (jid2job[i] == NULL)
-        {
-            jid2job[i] = job;
-            job->jid = i;
-            return job;
-        }
-    }
-    fprintf(stderr, "Maximum number of jobs exceeded\n");
-    abort();
-    return NULL;
+    return job;
 }
 
 /* Delete a job.
@@ -191,8 +486,14 @@ static void delete_job(struct job *job)
     assert(jid != -1);
     jid2job[jid]->jid = -1;
     jid2job[jid] = NULL;
+    bitmap_clear(&jid_bitmap, jid);
+    for (size_t i = 0; i < job->PID_list->curr_size; i++)
+    {
+        pid_index_remove(job->PID_list->data[i], job);
+    }
     ast_pipeline_free(job->pipe);
     clean_PID(job->PID_list);
+    free_chunks(job->chunks);
     free(job);
 }
 
@@ -220,11 +521,10 @@ static const char *get_status(enum job_status status)
 /* Print the command line that belongs to one job. */
 static void print_cmdline(struct ast_pipeline *pipeline)
 {
-    struct list_elem *e = list_begin(&pipeline->commands);
-    for (; e != list_end(&pipeline->commands); e = list_next(e))
+    for (size_t i = 0; i < pipeline->ncmds; i++)
     {
-        struct ast_command *cmd = list_entry(e, struct ast_command, elem);
-        if (e != list_begin(&pipeline->commands))
+        struct ast_command *cmd = &pipeline->cmdv[i];
+        if (i > 0)
             printf("| ");
         char **p = cmd->argv;
         printf("%s", *p++);
@@ -264,38 +564,130 @@ static void delete_done_jobs()
 }
 
 /*
- * Suggested SIGCHLD handler.
- *
+ * SIGCHLD is blocked for the whole lifetime of the shell and
+ * delivered through a signalfd instead, so that reaping happens
+ * synchronously in the main loop rather than in a signal handler
+ * that could interrupt the shell while it is updating the job list.
+ */
+static int sigchld_fd = -1;
+
+/*
+ * While the shell interprets a line it may own the terminal, e.g. in a
+ * loop of builtins, and then ^C, ^\ and ^Z reach the shell itself.  In
+ * interactive mode they are blocked while a line runs and read from
+ * this signalfd, so they end the line instead of the shell.  Children
+ * start with nothing blocked, see their spawn sigmask.
+ */
+static int intr_fd = -1;
+static sigset_t intr_mask;
+
+/* Consume pending ^C, ^\ and ^Z.  Returns the last signal, or 0. */
+static int take_interrupt(void)
+{
+    struct signalfd_siginfo info;
+    int sig = 0;
+    while (intr_fd != -1 && read(intr_fd, &info, sizeof info) == sizeof info)
+    {
+        sig = info.ssi_signo;
+    }
+    return sig;
+}
+
+/* Consume pending SIGCHLD notifications */
+static void drain_sigchld_fd(void)
+{
+    struct signalfd_siginfo info;
+    while (read(sigchld_fd, &info, sizeof info) == sizeof info)
+        ;
+}
+
+/* Turn the siginfo filled in by waitid() into a waitpid()-style status */
+static int siginfo_to_status(const siginfo_t *info)
+{
+    switch (info->si_code)
+    {
+    case CLD_EXITED:
+        return W_EXITCODE(info->si_status, 0);
+    case CLD_KILLED:
+        return info->si_status;
+    case CLD_DUMPED:
+        return info->si_status | WCOREFLAG;
+    default:
+        return W_STOPCODE(info->si_status);
+    }
+}
+
+/*
+ * Collect status changes of a job's processes through their pidfds,
+ * without blocking.  Returns true if any process changed status.
+ */
+static bool collect_job_status(struct job *job)
+{
+    struct PIDs *const pPIDs = job->PID_list;
+    bool changed = false;
+    for (size_t i = 0; i < pPIDs->curr_size; i++)
+    {
+        if (pPIDs->pidfds[i] < 0)
+        {
+            continue;
+        }
+
+        siginfo_t info = {0};
+        if (waitid(P_PIDFD, pPIDs->pidfds[i], &info, WEXITED | WSTOPPED | WNOHANG) == 0 && info.si_pid != 0)
+        {
+            handle_child_status(info.si_pid, siginfo_to_status(&info));
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+/*
  * Call waitpid() to learn about any child processes that
  * have exited or changed status (been stopped, needed the
  * terminal, etc.)
- * Just record the information by updating the job list
- * data structures.  Since the call may be spurious (e.g.
- * an already pending SIGCHLD is delivered even though
- * a foreground process was already reaped), ignore when
+ * Since the notification may be spurious (e.g. a foreground
+ * process was already reaped by wait_for_job), ignore when
  * waitpid returns -1.
  * Use a loop with WNOHANG since only a single SIGCHLD
- * signal may be delivered for multiple children that have
- * exited. All of them need to be reaped.
+ * may be pending for multiple children that have exited.
+ * All of them need to be reaped.
+ * Returns true if any child changed status.
  */
-static void
-sigchld_handler(int sig, siginfo_t *info, void *_ctxt)
+static bool reap_children(void)
 {
+    drain_sigchld_fd();
+
+    bool reaped = false;
     pid_t child;
     int status;
-
-    assert(sig == SIGCHLD);
-
     while ((child = waitpid(-1, &status, WUNTRACED | WNOHANG)) > 0)
     {
         handle_child_status(child, status);
+        reaped = true;
     }
+    return reaped;
+}
 
-    // DELETE HERE FOR KILL BUILT IN
+/* Report background jobs that have finished and delete
+ * jobs the shell no longer needs to track.
+ */
+static void cleanup_jobs(void)
+{
     for (struct list_elem *e = list_begin(&job_list); e != list_end(&job_list);)
     {
         struct job *j = list_entry(e, struct job, elem);
 
+        if (j->status == DONE)
+        {
+            if (interactive)
+            {
+                printf("[%d]\t%s\n", j->jid, get_status(j->status));
+            }
+
+            j->status = DELETE;
+        }
+
         if (j->status == DELETE)
         {
             e = list_remove(e);
@@ -338,6 +730,20 @@ wait_for_job(struct job *job)
 
     while (job->status == FOREGROUND && job->num_processes_alive > 0)
     {
+        if (job->PID_list->have_pidfds)
+        {
+            // wait on this job's own processes only; other children are
+            // left for reap_children
+            if (!collect_job_status(job))
+            {
+                struct pollfd pfd = {.fd = sigchld_fd, .events = POLLIN};
+                if (poll(&pfd, 1, -1) == -1 && errno != EINTR)
+                    utils_fatal_error("poll failed: ");
+                drain_sigchld_fd();
+            }
+            continue;
+        }
+
         int status;
 
         pid_t child = waitpid(-1, &status, WUNTRACED);
@@ -373,717 +779,1924 @@ handle_child_status(pid_t pid, int status)
      *         If a process was stopped, save the terminal state.
      */
 
-    for (struct list_elem *var = list_begin(&job_list); var != list_end(&job_list); var = list_next(var))
+    struct pid_entry *entry = pid_index_find(pid);
+    if (entry == NULL)
+    {
+        return;
+    }
+    struct job *sjob = entry->job;
+    size_t slot = entry->slot;
+
+    // Checks to see if process was stopped by a signal
+    // ctrl z
+    if (WIFSTOPPED(status))
     {
-        struct job *sjob = list_entry(var, struct job, elem);
 
-        if (!find_PID(sjob->PID_list, pid))
+        if (WSTOPSIG(status) == SIGTSTP || WSTOPSIG(status) == SIGSTOP)
         {
-            continue;
+            sjob->status = STOPPED;
+            print_job(sjob);
         }
-
-        // Checks to see if process was stopped by a signal
-        // ctrl z
-        if (WIFSTOPPED(status))
+        else if (WSTOPSIG(status) == SIGTTOU || WSTOPSIG(status) == SIGTTIN)
         {
-
-            if (WSTOPSIG(status) == SIGTSTP || WSTOPSIG(status) == SIGSTOP)
-            {
-                sjob->status = STOPPED;
-                print_job(sjob);
-            }
-            else if (WSTOPSIG(status) == SIGTTOU || WSTOPSIG(status) == SIGTTIN)
-            {
-                sjob->status = NEEDSTERMINAL;
-            }
-            termstate_save(&sjob->saved_tty_state);
+            sjob->status = NEEDSTERMINAL;
         }
-        // Checks to see if the process is terminated normally
+        termstate_save(&sjob->saved_tty_state);
+    }
+    // Checks to see if the process is terminated normally
 
-        // process exits via exit()
-        else if (WIFEXITED(status))
+    // process exits via exit()
+    else if (WIFEXITED(status))
+    {
+        pid_index_remove(pid, sjob);
+        mark_reaped(sjob->PID_list, slot);
+        sjob->num_processes_alive--;
+        if (pid == sjob->last_pid || (sjob->chunks && sjob->last_status == 0))
         {
-            sjob->num_processes_alive--;
-
-            if (sjob->status == FOREGROUND && sjob->num_processes_alive == 0)
-            {
-                sjob->status = DELETE;
-                termstate_sample();
-            }
-            // job is 100% complete here
-            if (sjob->num_processes_alive == 0 && sjob->status == BACKGROUND)
-            {
-                sjob->status = DONE;
-            }
+            sjob->last_status = WEXITSTATUS(status);
         }
-        // signal
-        else if (WIFSIGNALED(status))
+        // a chunked job starts its next batch; so that it cannot stall,
+        // also when it was stopped but this was its last process
+        if (sjob->chunks && (sjob->status == FOREGROUND || sjob->status == BACKGROUND
+                             || sjob->num_processes_alive == 0))
         {
-            // sjob->num_processes_alive--;
-            // if (sjob->num_processes_alive == 0)
-            // {
-            //     sjob->status = DELETE;
-            // }
-            sjob->status = DELETE;
+            run_chunks(sjob);
+        }
 
-            int term_sig = WTERMSIG(status);
-            printf("%s\n", strsignal(term_sig));
+        if (sjob->status == FOREGROUND && sjob->num_processes_alive == 0)
+        {
+            sjob->status = DELETE;
+            termstate_sample();
         }
-        else
+        // job is 100% complete here
+        if (sjob->num_processes_alive == 0 && sjob->status == BACKGROUND)
+        {
+            sjob->status = DONE;
+        }
+    }
+    // signal
+    else if (WIFSIGNALED(status))
+    {
+        // sjob->num_processes_alive--;
+        // if (sjob->num_processes_alive == 0)
+        // {
+        //     sjob->status = DELETE;
+        // }
+        pid_index_remove(pid, sjob);
+        mark_reaped(sjob->PID_list, slot);
+        sjob->status = DELETE;
+
+        int term_sig = WTERMSIG(status);
+        if (pid == sjob->last_pid || sjob->chunks)
         {
-            printf("Unknown child stats\n");
+            sjob->last_status = 128 + term_sig;
         }
+        printf("%s\n", strsignal(term_sig));
+    }
+    else
+    {
+        printf("Unknown child stats\n");
     }
 }
 
-int main(int ac, char *av[])
+/*
+ * Stress test for child reaping.
+ * Start njobs short-lived background jobs while SIGCHLD is blocked, so
+ * all of them are still in the job list when they are reaped, then time
+ * handle_child_status for each child.
+ */
+static void reap_stress(int njobs)
 {
-    int opt;
+    // no "[N] pid" lines or terminal handling: only the timing is printed
+    interactive = false;
+    signal_block(SIGCHLD);
+    for (int i = 0; i < njobs; i++)
+    {
+        char line[] = "/bin/true &";
+        struct ast_command_line *cline = ast_parse_command_line(line);
+        non_built_in(list_entry(list_front(&cline->pipes), struct ast_pipeline, elem));
+        ast_command_line_free(cline);
+    }
 
-    /* Process command-line arguments. See getopt(3) */
-    while ((opt = getopt(ac, av, "h")) > 0)
+    int reaped = 0;
+    double total_us = 0, max_us = 0;
+    pid_t child;
+    int status;
+    while ((child = waitpid(-1, &status, WUNTRACED)) > 0)
     {
-        switch (opt)
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        handle_child_status(child, status);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        double us = (end.tv_sec - start.tv_sec) * 1e6 + (end.tv_nsec - start.tv_nsec) / 1e3;
+        total_us += us;
+        if (us > max_us)
         {
-        case 'h':
-            usage(av[0]);
-            break;
+            max_us = us;
         }
+        reaped++;
     }
 
-    list_init(&job_list);
-    signal_set_handler(SIGCHLD, sigchld_handler);
-    termstate_init();
+    fprintf(stderr, "reaped %d children of %d jobs: mean %.3f us, max %.3f us per child\n",
+            reaped, njobs, reaped ? total_us / reaped : 0.0, max_us);
 
-    /* Read/eval loop. */
-    for (;;)
+    for (struct list_elem *e = list_begin(&job_list); e != list_end(&job_list);)
     {
+        struct job *j = list_entry(e, struct job, elem);
+        e = list_remove(e);
+        delete_job(j);
+    }
+    signal_unblock(SIGCHLD);
+}
 
-        /* If you fail this assertion, you were about to enter readline()
-         * while SIGCHLD is blocked.  This means that your shell would be
-         * unable to receive SIGCHLD signals, and thus would be unable to
-         * wait for background jobs that may finish while the
-         * shell is sitting at the prompt waiting for user input.
-         */
-        assert(!signal_is_blocked(SIGCHLD));
-
-        /* If you fail this assertion, you were about to call readline()
-         * without having terminal ownership.
-         * This would lead to the suspension of your shell with SIGTTOU.
-         * Make sure that you call termstate_give_terminal_back_to_shell()
-         * before returning here on all paths.
-         */
-        assert(termstate_get_current_terminal_owner() == getpgrp());
-
-        /* Do not output a prompt unless shell's stdin is a terminal */
-        char *prompt = isatty(0) ? build_prompt() : NULL;
-        char *cmdline = readline(prompt);
-        free(prompt);
+static bool line_handler_installed; // readline callback handler is active
+static bool shell_exiting;          // user typed EOF
 
-        if (cmdline == NULL) /* User typed EOF */
-            break;
+/* At the end of input, complain about a command that was never finished */
+static void report_unfinished_command(void)
+{
+    if (continued_line != NULL)
+    {
+        fprintf(stderr, "Unexpected end of file.\n");
+        end_continued_line();
+    }
+}
 
-        struct ast_command_line *cline = ast_parse_command_line(cmdline);
-        if (cline == NULL) /* Error in command line */
-            continue;
+/*
+ * Run a script or -c argument line by line, without readline or job
+ * control.
+ */
+static void run_script(struct script *script)
+{
+    char *line;
+    while ((line = script_next_line(script, continued_line != NULL)) != NULL)
+    {
+        eval_command_line(line);
+    }
+    report_unfinished_command();
+}
 
-        if (list_empty(&cline->pipes))
-        { /* User hit enter */
-            ast_command_line_free(cline);
-            continue;
+/* The same for a script file that was compiled, see script_cache.h */
+static void run_compiled_script(struct compiled_script *script)
+{
+    struct ast_command_line *cline;
+    while ((cline = compiled_script_next(script)) != NULL)
+    {
+        run_command_line(cline);
+    }
+}
+
+int main(int ac, char *av[])
+{
+    int opt;
+    int stress_jobs = 0;
+    struct script *script = NULL;
+    struct compiled_script *compiled = NULL;
+
+    /* Process command-line arguments. See getopt(3) */
+    while ((opt = getopt(ac, av, "+ac:hj:R:x")) > 0)
+    {
+        switch (opt)
+        {
+        case 'a':
+            cache_appends = true;
+            break;
+        case 'c':
+            script = script_from_string(optarg);
+            break;
+        case 'h':
+            usage(av[0]);
+            break;
+        case 'j':
+            max_jobs = atoi(optarg) + 1;
+            if (max_jobs < 2)
+            {
+                usage(av[0]);
+            }
+            break;
+        case 'R':
+            stress_jobs = atoi(optarg);
+            break;
+        case 'x':
+            external_utilities = true;
+            break;
         }
+    }
+    variables_init(environ);
+    if (script == NULL && optind < ac)
+    {
+        // a script that does not parse throughout runs from its image up
+        // to the command that fails, then line by line
+        size_t rest;
+        compiled = script_cache_open(av[optind]);
+        if (compiled == NULL || compiled_script_rest(compiled, &rest))
+        {
+            script = script_open(av[optind]);
+            if (script == NULL)
+            {
+                utils_fatal_error("%s: ", av[optind]);
+            }
+            if (compiled != NULL)
+            {
+                script_seek(script, rest);
+            }
+        }
+    }
 
-        /*
-        =====================================================================================================
-        HANDLE HISTORY HERE
-        =====================================================================================================
-        */
+    list_init(&job_list);
+    bitmap_init(&jid_bitmap);
+    bitmap_grow(&jid_bitmap, 1);
+    bitmap_set(&jid_bitmap, 0); // job ids start at 1
+    if (stress_jobs > 0)
+    {
+        reap_stress(stress_jobs);
+        return 0;
+    }
 
-        using_history();
-        char *historyElem;
+    sigset_t sigchld_mask;
+    sigemptyset(&sigchld_mask);
+    sigaddset(&sigchld_mask, SIGCHLD);
+    signal_block(SIGCHLD);
+    sigchld_fd = signalfd(-1, &sigchld_mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (sigchld_fd == -1)
+    {
+        utils_fatal_error("signalfd failed: ");
+    }
+
+    /* The shell installs no signal handlers of its own, and readline's
+     * are only in place while it reads input, never during a spawn.
+     * Let posix_spawn skip resetting every signal in the child. */
+    sigset_t no_handlers;
+    sigemptyset(&no_handlers);
+    posix_spawn_set_handled_signals_np(&no_handlers);
 
-        int result = history_expand(cmdline, &historyElem);
-        if (result)
+    if (compiled != NULL)
+    {
+        interactive = false;
+        run_compiled_script(compiled);
+        compiled_script_close(compiled);
+        if (script == NULL)
         {
-            fprintf(stderr, "%s\n", historyElem);
-            ast_command_line_free(cline);
-            cline = ast_parse_command_line(historyElem);
+            return last_status;
         }
+    }
+    if (script != NULL)
+    {
+        interactive = false;
+        run_script(script);
+        script_close(script);
+        return last_status;
+    }
 
-        if (result < 0 || result == 2)
+    termstate_init();
+    using_history();
+
+    sigemptyset(&intr_mask);
+    sigaddset(&intr_mask, SIGINT);
+    sigaddset(&intr_mask, SIGQUIT);
+    sigaddset(&intr_mask, SIGTSTP);
+    intr_fd = signalfd(-1, &intr_mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (intr_fd == -1)
+    {
+        utils_fatal_error("signalfd failed: ");
+    }
+
+    /* Read/eval loop.
+     * readline is driven through its callback interface so that the
+     * shell can wait for input and for SIGCHLD at the same time.
+     */
+    while (!shell_exiting)
+    {
+        /* If you fail this assertion, you were about to wait for input
+         * without having terminal ownership.
+         * This would lead to the suspension of your shell with SIGTTOU.
+         * Make sure that you call termstate_give_terminal_back_to_shell()
+         * before returning here on all paths.
+         */
+        assert(termstate_get_current_terminal_owner() == getpgrp());
+
+        if (!line_handler_installed)
         {
-            free(historyElem);
-            continue;
+            /* Do not output a prompt unless shell's stdin is a terminal */
+            char *prompt = isatty(0) ? build_prompt() : NULL;
+            rl_callback_handler_install(prompt, handle_line);
+            free(prompt);
+            line_handler_installed = true;
         }
 
-        add_history(historyElem);
+        struct pollfd fds[2] = {
+            {.fd = 0, .events = POLLIN},
+            {.fd = sigchld_fd, .events = POLLIN},
+        };
+        if (poll(fds, 2, -1) == -1)
+        {
+            if (errno == EINTR)
+                continue;
+            utils_fatal_error("poll failed: ");
+        }
 
-        /*
-        =====================================================================================================
-        HANDLE COMMAND LINE HERE
-        =====================================================================================================
-        */
-        if (signal_block(SIGCHLD))
+        if (fds[1].revents & POLLIN)
         {
-            utils_error("Error blocking SIGCHLD");
+            /* A background job changed status while the user is typing.
+             * Report it right away and redraw the partial input line.
+             */
+            rl_clear_visible_line();
+            reap_children();
+            cleanup_jobs();
+            fflush(stdout);
+            rl_on_new_line();
+            rl_redisplay();
         }
-        list_front(&cline->pipes);
 
-        // loop through the command line and execute the different pipes
-        for (struct list_elem *e = list_begin(&cline->pipes); e != list_end(&cline->pipes);)
+        if (fds[0].revents)
         {
+            rl_callback_read_char();
+        }
+    }
 
-            struct ast_pipeline *pipee = list_entry(e, struct ast_pipeline, elem);
+    if (line_handler_installed)
+    {
+        rl_callback_handler_remove();
+    }
+    return 0;
+}
 
-            e = list_remove(e);
-            exe_pipelines(pipee);
+/*
+ * Apply history expansion to a line, printing the result as csh does.
+ * Returns the line to run, which is cmdline itself if it has no history
+ * references, or NULL if expansion failed or only printed (:p).
+ * A result other than cmdline must be freed by the caller.
+ */
+static char *expand_history(char *cmdline)
+{
+    // most lines have no history character; don't scan them twice
+    if (strchr(cmdline, history_expansion_char) == NULL && cmdline[0] != history_subst_char)
+    {
+        return cmdline;
+    }
+
+    char *expanded;
+    int result = history_expand(cmdline, &expanded);
+    if (result)
+    {
+        fprintf(stderr, "%s\n", expanded);
+    }
+    if (result < 0 || result == 2)
+    {
+        free(expanded);
+        return NULL;
+    }
+    return expanded;
+}
+
+/*
+=====================================================================================================
+HANDLE COMMAND LINE HERE
+=====================================================================================================
+*/
+/* Directory listings read by pathname expansion.  They are kept while
+ * one pipeline's words are expanded and forgotten once it has run, since
+ * it may have created or removed files. */
+static struct glob_cache *glob_cache;
+
+static struct glob_cache *get_glob_cache(void)
+{
+    if (glob_cache == NULL)
+    {
+        glob_cache = glob_cache_create();
+    }
+    return glob_cache;
+}
+
+static void forget_directories(void)
+{
+    if (glob_cache)
+    {
+        glob_cache_clear(glob_cache);
+    }
+}
+
+/* Copy word into arena, expanding variables */
+static char *expand_word(struct arena *arena, char *word)
+{
+    char *expanded = variables_expand(arena, word, last_status);
+    if (expanded == word)
+    {
+        expanded = strcpy(arena_alloc(arena, strlen(word) + 1), word);
+    }
+    return expanded;
+}
+
+/* The same for a NULL terminated array of words, which may be NULL.
+ * With glob set, a word that is a pattern after expansion is replaced by
+ * the paths it matches, or kept as it is if nothing matches; words that
+ * were quoted, as 'quoted' says if it is not NULL, are left alone. */
+static char **expand_words(struct arena *arena, char **words, bool glob, const bool *quoted)
+{
+    if (words == NULL)
+    {
+        return NULL;
+    }
+    size_t n = 0, cap = 8;
+    char **expanded = malloc(cap * sizeof(*expanded));
+    for (size_t i = 0; words[i]; i++)
+    {
+        char *word = expand_word(arena, words[i]);
+        size_t nmatches = 0;
+        char **matches = NULL;
+        if (glob && !(quoted && quoted[i]) && glob_is_pattern(word))
+        {
+            matches = glob_expand(get_glob_cache(), arena, word, &nmatches);
+        }
+        if (matches == NULL)
+        {
+            matches = &word;
+            nmatches = 1;
         }
+        if (n + nmatches + 1 > cap)
+        {
+            while (n + nmatches + 1 > cap)
+            {
+                cap *= 2;
+            }
+            expanded = realloc(expanded, cap * sizeof(*expanded));
+        }
+        memcpy(expanded + n, matches, nmatches * sizeof(*matches));
+        n += nmatches;
+    }
+    expanded[n] = NULL;
+
+    char **result = memcpy(arena_alloc(arena, (n + 1) * sizeof(*result)), expanded,
+                           (n + 1) * sizeof(*result));
+    free(expanded);
+    return result;
+}
 
-        if (!signal_unblock(SIGCHLD))
+static bool has_dollar(const char *word)
+{
+    return word && strchr(word, '$');
+}
+
+/* Whether the slices of a here-document body hold a '$' */
+static bool here_has_dollar(const struct iovec *here, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        if (memchr(here[i].iov_base, '$', here[i].iov_len))
         {
-            utils_error("Error blocking SIGCHLD");
+            return true;
         }
+    }
+    return false;
+}
 
-        for (struct list_elem *e = list_begin(&job_list); e != list_end(&job_list);)
+/* Whether any of words needs variable or, with glob set, pathname expansion */
+static bool words_need_expansion(char **words, bool glob, const bool *quoted)
+{
+    for (size_t i = 0; words && words[i]; i++)
+    {
+        if (has_dollar(words[i]) || (glob && !(quoted && quoted[i]) && glob_is_pattern(words[i])))
         {
-            struct job *j = list_entry(e, struct job, elem);
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Return the pipeline to run for pipe, with its variables and the
+ * patterns among its arguments expanded.  Without a '$' or a pattern in
+ * any of its words that is pipe itself; otherwise it is
+ * a copy in an arena of its own, which a job can hold on to like any
+ * parsed pipeline.  Either way the caller drops one reference.
+ */
+static struct ast_pipeline *expand_pipeline(struct ast_pipeline *pipe)
+{
+    bool expand = has_dollar(pipe->iored_input) || has_dollar(pipe->iored_output)
+                  || (!pipe->here_literal && here_has_dollar(pipe->here, pipe->nhere));
+    for (size_t i = 0; i < pipe->ncmds && !expand; i++)
+    {
+        expand = words_need_expansion(pipe->cmdv[i].argv, true, pipe->cmdv[i].quoted)
+                 || words_need_expansion(pipe->cmdv[i].assignments, false, NULL);
+    }
+    if (!expand)
+    {
+        return ast_pipeline_get(pipe);
+    }
+
+    struct arena *arena = arena_create(1024);
+    struct ast_pipeline *copy = ast_pipeline_create(
+        arena, pipe->ncmds,
+        pipe->iored_input ? expand_word(arena, pipe->iored_input) : NULL,
+        pipe->iored_output ? expand_word(arena, pipe->iored_output) : NULL,
+        pipe->append_to_output);
+    if (pipe->here)
+    {
+        char *text = ast_pipeline_here_text(pipe, arena);
+        ast_pipeline_set_here_text(copy, pipe->here_literal ? text : expand_word(arena, text));
+    }
+    copy->here_literal = pipe->here_literal;
+    copy->bg_job = pipe->bg_job;
+    for (size_t i = 0; i < pipe->ncmds; i++)
+    {
+        struct ast_command *command = &pipe->cmdv[i];
+        ast_pipeline_add_command(copy, expand_words(arena, command->argv, true, command->quoted),
+                                 expand_words(arena, command->assignments, false, NULL),
+                                 command->dup_stderr_to_stdout);
+    }
+    return copy;
+}
 
-            if (j->status == DONE)
+/* Set a variable from word, an assignment, expanding variables in it first */
+static void assign_variable(char *word)
+{
+    struct arena *arena = NULL;
+    if (strchr(word, '$'))
+    {
+        arena = arena_create(256);
+        word = variables_expand(arena, word, last_status);
+    }
+    variables_assign(word);
+    if (arena)
+    {
+        arena_put(arena);
+    }
+}
+
+/* Run a parsed command line, then report and clean up jobs.
+ * Drops the caller's reference to the command line.
+ * The line's code is interpreted directly, see shell-ast.h; a pipeline
+ * on a branch that is not taken is never looked at. */
+static void run_command_line(struct ast_command_line *cline)
+{
+    assert(signal_is_blocked(SIGCHLD));
+
+    struct for_loop
+    {
+        char **words;         // the loop's words, expanded when it starts
+        size_t next;          // the next one to assign
+        struct arena *arena;  // holds words
+    } loops[cline->nloops + 1];
+    memset(loops, 0, sizeof(loops));
+    interrupted = false;
+    if (interactive)
+    {
+        sigprocmask(SIG_BLOCK, &intr_mask, NULL);
+    }
+    size_t pc = 0;
+    while (pc < cline->ncode && !interrupted)
+    {
+        struct ast_op *op = &cline->code[pc++];
+        switch (op->opcode)
+        {
+        case AST_OP_RUN:
+        {
+            struct ast_pipeline *pipe = expand_pipeline(op->pipe);
+            forget_directories();
+            last_status = exe_pipelines(pipe);
+            ast_pipeline_free(pipe);
+            break;
+        }
+        case AST_OP_JUMP:
+            // every loop jumps back, so a loop of builtins checks here
+            pc = op->target;
+            int sig = take_interrupt();
+            if (sig != 0)
+            {
+                last_status = 128 + sig;
+                interrupted = true;
+            }
+            break;
+        case AST_OP_JUMP_IF_OK:
+            if (last_status == 0)
+            {
+                pc = op->target;
+            }
+            break;
+        case AST_OP_JUMP_IF_FAILED:
+            if (last_status != 0)
             {
+                pc = op->target;
+            }
+            break;
+        case AST_OP_SET_STATUS:
+            last_status = op->arg;
+            break;
+        case AST_OP_FOR_START:
+            if (loops[op->arg].arena)
+            {
+                arena_put(loops[op->arg].arena);
+            }
+            loops[op->arg].arena = NULL;
+            loops[op->arg].words = NULL;
+            loops[op->arg].next = 0;
+            break;
+        case AST_OP_FOR_NEXT:
+        {
+            struct for_loop *loop = &loops[op->arg];
+            if (loop->words == NULL)
+            {
+                loop->arena = arena_create(1024);
+                loop->words = expand_words(loop->arena, op->words, true, op->quoted);
+                forget_directories();
+            }
+            if (loop->words[loop->next] == NULL)
+            {
+                pc = op->target;
+                break;
+            }
+            variables_set(op->name, loop->words[loop->next++]);
+            break;
+        }
+        case AST_OP_ASSIGN:
+            for (char **word = op->words; *word; word++)
+            {
+                assign_variable(*word);
+            }
+            last_status = 0;
+            break;
+        }
+    }
+    for (size_t i = 0; i <= cline->nloops; i++)
+    {
+        if (loops[i].arena)
+        {
+            arena_put(loops[i].arena);
+        }
+    }
+    if (interactive)
+    {
+        // a key typed after the last check does not outlive the line
+        take_interrupt();
+        sigprocmask(SIG_UNBLOCK, &intr_mask, NULL);
+    }
 
-                printf("[%d]\t%s\n", j->jid, get_status(j->status));
+    // pick up status changes of jobs signaled by this command line
+    reap_children();
+    cleanup_jobs();
+
+    /* Free the command line.
+     * Pipelines that became jobs hold their own reference.
+     */
+    ast_command_line_free(cline);
+}
+
+/* Parse and run one command line.
+ * If it ends in the middle of a command, the parser keeps its state and
+ * goes on with the following lines, and the command runs once it is
+ * complete.  No line is parsed twice. */
+static void eval_command_line(char *cmdline)
+{
+    // expand history references first, so the line is parsed only once
+    char *line = interactive ? expand_history(cmdline) : cmdline;
+    if (line == NULL)
+        return;
+
+    // a command started on an earlier line continues on this one
+    bool continued = continued_line != NULL;
+    struct ast_command_line *cline = continued ? ast_parse_continued_line(line)
+                                               : parse_cache_parse(line);
+    bool incomplete = cline == NULL && ast_parse_incomplete();
+    if (continued || incomplete)
+    {
+        append_continued_line(line);
+    }
+    if (!incomplete && cline != NULL && cline->ncode > 0 && interactive)
+    {
+        add_history(continued ? continued_line : line);
+    }
+    if (line != cmdline)
+    {
+        free(line);
+    }
+    if (incomplete)
+    { /* e.g. an if without its fi: wait until the rest is entered */
+        return;
+    }
+    if (continued)
+    {
+        end_continued_line();
+    }
+
+    if (cline == NULL || cline->ncode == 0)
+    { /* Error in command line, or user hit enter */
+        if (cline != NULL)
+        {
+            ast_command_line_free(cline);
+        }
+        return;
+    }
+    run_command_line(cline);
+}
+
+/* readline callback, invoked once a complete line has been entered */
+static void handle_line(char *cmdline)
+{
+    /* Restore the terminal for the commands we are about to run;
+     * the handler is installed again before waiting for more input. */
+    rl_callback_handler_remove();
+    line_handler_installed = false;
+
+    if (cmdline == NULL) /* User typed EOF */
+    {
+        report_unfinished_command();
+        shell_exiting = true;
+        return;
+    }
+
+    eval_command_line(cmdline);
+    free(cmdline);
+}
+
+/* Builtins run in the shell, or in a forked copy of it when they feed a pipe.
+ * Each returns its exit status. */
+/* exit [status], 0 by default */
+static int builtin_exit(char *const *argv)
+{
+    exit(argv[1] ? atoi(argv[1]) & 0xff : 0);
+}
+
+/* The job whose pipeline a builtin is part of, while that builtin runs */
+static struct job *builtin_job;
+
+static int builtin_jobs(char *const *argv)
+{
+    for (struct list_elem *i = list_begin(&job_list); i != list_end(&job_list); i = list_next(i))
+    {
+        struct job *job_entry = list_entry(i, struct job, elem);
+        if (job_entry != builtin_job)
+        {
+            print_job(job_entry);
+        }
+    }
+    return 0;
+}
+
+static int builtin_bg(char *const *argv)
+{
+    // SIGCONT singal will bring the process back to the foreground, bringing it back to a running state??
+    //  Crtl + Z will give a SIGTSTP singal to stop the process
+    //  Are we suppose to use the kill command in this function?
+    //  running in background and stop is not runnning at all
+    //  changing the status of the job and continuing but in stop you would send the stop signal
+    pid_t id = atoi(argv[1]);
+
+    if (get_job_from_jid(id) == NULL)
+    {
+        printf("JOB DOESNT EXIST\n");
+    }
+    else
+    {
+        struct job *sjob = get_job_from_jid(id);
+
+        if (sjob == NULL)
+        {
+            printf("Error error");
+        }
+        else if (sjob->jid == id)
+        {
+            if (sjob->status == BACKGROUND)
+            {
+                printf("already bg\n");
+            }
+            else
+            {
+                sjob->status = BACKGROUND;
+                signal_job(sjob, SIGCONT);
+                printf("[%d] %d\n", sjob->jid, sjob->pgid);
+            }
+        }
+    }
+    return 0;
+}
+
+static int builtin_fg(char *const *argv)
+{
+    pid_t id = atoi(argv[1]);
+
+    if (get_job_from_jid(id) == NULL)
+    {
+        printf("JOB DOESNT EXIST\n");
+    }
+    else
+    {
+        struct job *sjob = get_job_from_jid(id);
+
+        if (sjob == NULL)
+        {
+            printf("Error error");
+        }
+        else if (sjob->jid == id)
+        {
+            struct termios *state = NULL;
+            if (sjob->status != BACKGROUND)
+            {
+                state = &sjob->saved_tty_state;
+            }
+            sjob->status = FOREGROUND;
+            print_cmdline(sjob->pipe);
+            printf("\n");
+
+            termstate_give_terminal_to(state, sjob->pgid);
+            if (signal_job(sjob, SIGCONT))
+            {
+                utils_error("Error sending SIGCONT in fg");
+            }
+            wait_for_job(sjob);
+            termstate_give_terminal_back_to_shell();
+        }
+    }
+    return 0;
+}
+
+static int builtin_stop(char *const *argv)
+{
+    pid_t id = atoi(argv[1]);
+
+    if (get_job_from_jid(id) == NULL)
+    {
+        printf("JOB DOESNT EXIST\n");
+    }
+    else
+    {
+        struct job *sjob = get_job_from_jid(id);
+
+        if (sjob == NULL)
+        {
+            printf("Error error");
+        }
+        else if (sjob->jid == id)
+        {
+            sjob->status = STOPPED;
+            if (signal_job(sjob, SIGSTOP))
+            {
+                utils_error("Error dending SIGSTOP in stop");
+            }
+            termstate_give_terminal_back_to_shell();
+        }
+    }
+    return 0;
+}
+
+static int builtin_kill(char *const *argv)
+{
+    pid_t id = atoi(argv[1]);
+
+    if (get_job_from_jid(id) == NULL)
+    {
+        printf("JOB DOESNT EXIST\n");
+    }
+    else
+    {
+        struct job *sjob = get_job_from_jid(id);
+
+        if (sjob == NULL)
+        {
+            printf("Error error");
+        }
+        else if (sjob->jid == id)
+        {
+            if (signal_job(sjob, SIGKILL))
+            {
+                utils_error("Error sending SIGKILL in kill");
+            }
+            termstate_give_terminal_back_to_shell();
+        }
+    }
+    return 0;
+}
+
+static int builtin_cd(char *const *argv)
+{
+    const char *path = argv[1];
+    if (!path)
+    {
+        path = variables_get("HOME");
+    }
+    if (!path)
+    {
+        fprintf(stderr, "cd: HOME not set\n");
+        return 1;
+    }
+    if (chdir(path) == -1)
+    {
+        utils_error("cd: %s: No such file or directory\n", path);
+        return 1;
+    }
+    return 0;
+}
+
+static int builtin_history(char *const *argv)
+{
+    // Display the command history
+    HIST_ENTRY **histList = history_list();
+    int history_len = history_length;
+
+    for (int i = 0; i < history_len; i++)
+    {
+        printf("  %d %s\n", i + 1, histList[i]->line);
+    }
+    return 0;
+}
+
+static int builtin_hash(char *const *argv)
+{
+    if (argv[1] == NULL)
+    {
+        command_hash_print();
+    }
+    else if (strcmp(argv[1], "-r") == 0)
+    {
+        command_hash_clear();
+    }
+    else if (strcmp(argv[1], "-p") == 0)
+    {
+        if (argv[2] == NULL || argv[3] == NULL)
+        {
+            fprintf(stderr, "hash: usage: hash [-r] [-p pathname name] [name ...]\n");
+            return 1;
+        }
+        command_hash_insert(argv[3], argv[2]);
+    }
+    else
+    {
+        int rc = 0;
+        for (char *const *p = argv + 1; *p; p++)
+        {
+            if (strchr(*p, '/') == NULL && command_hash_lookup(*p) == NULL)
+            {
+                fprintf(stderr, "hash: %s: not found\n", *p);
+                rc = 1;
+            }
+        }
+        return rc;
+    }
+    return 0;
+}
+
+static int builtin_parsecache(char *const *argv)
+{
+    if (argv[1] == NULL)
+    {
+        parse_cache_print();
+    }
+    else if (strcmp(argv[1], "-r") == 0 && argv[2] == NULL)
+    {
+        parse_cache_clear();
+    }
+    else
+    {
+        fprintf(stderr, "parsecache: usage: parsecache [-r]\n");
+        return 1;
+    }
+    return 0;
+}
+
+static int builtin_appendcache(char *const *argv)
+{
+    if (argv[1] == NULL)
+    {
+        printf("append cache: %s\n", cache_appends ? "on" : "off");
+        append_cache_print();
+    }
+    else if (strcmp(argv[1], "on") == 0 && argv[2] == NULL)
+    {
+        cache_appends = true;
+    }
+    else if (strcmp(argv[1], "off") == 0 && argv[2] == NULL)
+    {
+        cache_appends = false;
+        append_cache_clear();
+    }
+    else if (strcmp(argv[1], "-r") == 0 && argv[2] == NULL)
+    {
+        append_cache_clear();
+    }
+    else
+    {
+        fprintf(stderr, "appendcache: usage: appendcache [on | off | -r]\n");
+        return 1;
+    }
+    return 0;
+}
+
+static int builtin_export(char *const *argv)
+{
+    if (argv[1] == NULL)
+    {
+        variables_print_exported();
+        return 0;
+    }
+    int rc = 0;
+    for (char *const *p = argv + 1; *p; p++)
+    {
+        if (!variables_export(*p))
+        {
+            fprintf(stderr, "export: %s: not a valid identifier\n", *p);
+            rc = 1;
+        }
+    }
+    return rc;
+}
+
+static int builtin_unset(char *const *argv)
+{
+    int rc = 0;
+    for (char *const *p = argv + 1; *p; p++)
+    {
+        if (!variables_is_name(*p, strlen(*p)))
+        {
+            fprintf(stderr, "unset: %s: not a valid identifier\n", *p);
+            rc = 1;
+            continue;
+        }
+        variables_unset(*p);
+    }
+    return rc;
+}
+
+/* Reached only when chunk ends a pipeline; on its own it is run_chunked */
+static int builtin_chunk(char *const *argv)
+{
+    fprintf(stderr, "chunk: cannot be used in a pipeline\n");
+    return 2;
+}
+
+/* A builtin without BUILTIN_PIPELINE changes shell state, so it must run in the shell */
+#define BUILTIN_PIPELINE 0x01 /* may run as a pipeline stage, in a forked shell */
+#define BUILTIN_JOBARG 0x02   /* takes a job id as its first argument */
+#define BUILTIN_UTILITY 0x04  /* stands in for an external program, see -x */
+#define BUILTIN_PREFIX 0x08   /* runs the rest of its command as a job of its own */
+
+struct builtin
+{
+    const char *name;
+    int (*handler)(char *const *argv);
+    int flags;
+};
+
+/* Registered in builtins.def, which also feeds the generated perfect hash */
+static const struct builtin builtins[] = {
+#define BUILTIN(name, handler, flags) {name, handler, flags},
+#include "builtins.def"
+#undef BUILTIN
+};
+
+#include "builtin_hash.h"
+
+/* Return the builtin called name, or NULL */
+static const struct builtin *find_builtin(const char *name)
+{
+    size_t len = strlen(name);
+    if (len == 0)
+    {
+        return NULL;
+    }
+    int slot = builtin_slots[builtin_name_hash(name, len)];
+    if (slot < 0 || strcmp(builtins[slot].name, name) != 0)
+    {
+        return NULL;
+    }
+    if ((builtins[slot].flags & BUILTIN_UTILITY) && external_utilities)
+    {
+        return NULL;
+    }
+    return &builtins[slot];
+}
+
+/* Run builtin b with argv, checking the arguments its flags promise */
+static int call_builtin(const struct builtin *b, char *const *argv)
+{
+    if (b->flags & BUILTIN_JOBARG)
+    {
+        char *end = NULL;
+        if (argv[1] != NULL)
+        {
+            strtol(argv[1], &end, 10);
+        }
+        if (end == NULL || end == argv[1] || *end != '\0')
+        {
+            fprintf(stderr, "%s: usage: %s JOB_ID\n", argv[0], argv[0]);
+            return 2;
+        }
+    }
+    return b->handler(argv);
+}
+
+/* Entry point of the forked child that runs a builtin feeding a pipe */
+static int run_builtin_child(char *const *argv)
+{
+    int rc = call_builtin(find_builtin(argv[0]), argv);
+    fflush(stdout);
+    return rc;
+}
+
+/* Point descriptor 'target' at fd, keeping the original in saved[target] */
+static void redirect_fd(int fd, int target, int saved[])
+{
+    if (saved[target] < 0)
+    {
+        saved[target] = fcntl(target, F_DUPFD_CLOEXEC, 10);
+    }
+    dup2(fd, target);
+}
+
+/**
+ * Return a descriptor for the text of a here-document or here-string,
+ * given as the nhere slices in here, to be dup'd onto a command's
+ * standard input: a sealed memfd into which the text is written once,
+ * positioned at its start.  Returns -1
+ * after reporting an error.
+ */
+static int here_text_fd(const struct iovec *here, size_t nhere)
+{
+    int fd = memfd_create("cush-here", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd < 0)
+    {
+        utils_error("memfd_create: ");
+        return -1;
+    }
+    // the slices are written with as few calls as writev allows; after
+    // a short write the rest goes from a copy of the remaining vector
+    struct iovec *iov = malloc((nhere ? nhere : 1) * sizeof *iov);
+    memcpy(iov, here, nhere * sizeof *iov);
+    struct iovec *next = iov;
+    size_t left = nhere;
+    while (left > 0)
+    {
+        ssize_t n = writev(fd, next, left > IOV_MAX ? IOV_MAX : left);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n < 0)
+        {
+            utils_error("here-document: ");
+            free(iov);
+            close(fd);
+            return -1;
+        }
+        for (; left > 0 && (size_t) n >= next->iov_len; left--, next++)
+        {
+            n -= next->iov_len;
+        }
+        if (left > 0)
+        {
+            next->iov_base = (char *) next->iov_base + n;
+            next->iov_len -= n;
+        }
+    }
+    free(iov);
+    fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL);
+    lseek(fd, 0, SEEK_SET);
+    return fd;
+}
+
+/**
+ * Run a builtin in the shell itself.  Its standard input comes from
+ * infile or infd, and its standard output goes to the pipeline's output
+ * file; the shell's own descriptors are put back afterwards.
+ */
+static int run_builtin_here(const struct builtin *b, struct ast_command *command,
+                            const char *infile, int infd, struct ast_pipeline *pipee)
+{
+    int saved[3] = {-1, -1, -1};
+    int status = 1;
+    fflush(stdout);
+
+    if (infile)
+    {
+        int fd = open(infile, O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+        {
+            utils_error("%s: ", infile);
+            return status;
+        }
+        redirect_fd(fd, STDIN_FILENO, saved);
+        close(fd);
+    }
+    else if (infd >= 0)
+    {
+        redirect_fd(infd, STDIN_FILENO, saved);
+    }
+
+    int cached = -1;
+    if (pipee->iored_output && pipee->append_to_output && cache_appends)
+    {
+        cached = append_cache_get(pipee->iored_output);
+    }
+    if (cached >= 0)
+    {
+        redirect_fd(cached, STDOUT_FILENO, saved);
+    }
+    else if (pipee->iored_output)
+    {
+        int term = pipee->append_to_output ? O_APPEND : O_TRUNC;
+        int fd = open(pipee->iored_output, O_WRONLY | O_CREAT | O_CLOEXEC | term, 0666);
+        if (fd < 0)
+        {
+            utils_error("%s: ", pipee->iored_output);
+            goto restore;
+        }
+        redirect_fd(fd, STDOUT_FILENO, saved);
+        close(fd);
+    }
+    if (command->dup_stderr_to_stdout)
+    {
+        redirect_fd(STDOUT_FILENO, STDERR_FILENO, saved);
+    }
 
-                j->status = DELETE;
-            }
+    status = call_builtin(b, command->argv);
 
-            if (j->status == DELETE)
-            {
-                e = list_remove(e);
-                delete_job(j);
-            }
-            else
-            {
-                e = list_next(e);
-            }
+restore:
+    fflush(stdout);
+    fflush(stderr);
+    for (int fd = 0; fd < 3; fd++)
+    {
+        if (saved[fd] >= 0)
+        {
+            dup2(saved[fd], fd);
+            close(saved[fd]);
         }
-        /* Free the command line.
-         * This will free the ast_pipeline objects still contained
-         * in the ast_command_line.  Once you implement a job list
-         * that may take ownership of ast_pipeline objects that are
-         * associated with jobs you will need to reconsider how you
-         * manage the lifetime of the associated ast_pipelines.
-         * Otherwise, freeing here will cause use-after-free errors.
-         */
-        free(cmdline);
-        free(historyElem);
-        free(cline);
     }
-
-    return 0;
+    return status;
 }
 
-static void exe_pipelines(struct ast_pipeline *pipee)
+/* Run a pipeline and return its exit status, that of its last command */
+static int exe_pipelines(struct ast_pipeline *pipee)
 {
-    // TODO: free ast_pipeline *pipee after a built in command is executed
-    // find the fist command and check to see if the command is a built in or requires posix spawn
-    struct list_elem *a = list_begin(&pipee->commands);
-    struct ast_command *command = list_entry(a, struct ast_command, elem);
+    // a single builtin runs in the shell; anything else becomes a job,
+    // which takes care of builtins elsewhere in the pipeline
+    struct ast_command *command = &pipee->cmdv[0];
+    const struct builtin *b = find_builtin(command->argv[0]);
 
-    if (strcmp(command->argv[0], "exit") == 0)
+    if (b && pipee->ncmds == 1 && (b->flags & BUILTIN_PREFIX))
     {
-        exit(0);
+        return run_chunked(pipee);
     }
-    else if (strcmp(command->argv[0], "jobs") == 0)
+    if (b && pipee->ncmds == 1 && pipee->here)
     {
-        for (struct list_elem *i = list_begin(&job_list); i != list_end(&job_list); i = list_next(i))
+        int infd = here_text_fd(pipee->here, pipee->nhere);
+        if (infd < 0)
         {
-            struct job *job_entry = list_entry(i, struct job, elem);
-            print_job(job_entry);
+            return 1;
         }
-        ast_pipeline_free(pipee);
+        int status = run_builtin_here(b, command, NULL, infd, pipee);
+        close(infd);
+        return status;
     }
-    else if (strcmp(command->argv[0], "bg") == 0)
+    if (b && pipee->ncmds == 1)
     {
-        // SIGCONT singal will bring the process back to the foreground, bringing it back to a running state??
-        //  Crtl + Z will give a SIGTSTP singal to stop the process
-        //  Are we suppose to use the kill command in this function?
-        //  running in background and stop is not runnning at all
-        //  changing the status of the job and continuing but in stop you would send the stop signal
-        pid_t id = atoi(command->argv[1]);
+        return run_builtin_here(b, command, pipee->iored_input, -1, pipee);
+    }
+    return non_built_in(pipee);
+}
 
-        if (jid2job[id] == NULL)
-        {
-            printf("JOB DOESNT EXIST\n");
-        }
-        else
-        {
-            struct job *sjob = jid2job[id];
+/* Scratch space for spawning pipelines, reused across calls */
+static struct posix_spawn_stage *stages;
+static size_t stages_cap;
+static char *stage_paths;
+static size_t stage_paths_cap;
 
-            if (sjob == NULL)
-            {
-                printf("Error error");
-            }
-            else if (sjob->jid == id)
-            {
-                if (sjob->status == BACKGROUND)
-                {
-                    printf("already bg\n");
-                }
-                else
-                {
-                    sjob->status = BACKGROUND;
-                    killpg(sjob->pgid, SIGCONT);
-                    printf("[%d] %d\n", sjob->jid, sjob->pgid);
-                }
-            }
-        }
-        ast_pipeline_free(pipee);
-    }
-    else if (strcmp(command->argv[0], "fg") == 0)
+/**
+ * Fill in stages[] for the first nstages commands of a pipeline.  Builtins
+ * run in a forked shell; other names are resolved through the command hash
+ * so the child execs a known path instead of searching $PATH itself.  The
+ * paths are copied into stage_paths, since a result of command_hash_lookup
+ * may not outlive the next lookup.
+ * Returns false after printing an error if a command cannot be run.
+ */
+static bool prepare_stages(struct ast_pipeline *pipee, size_t nstages)
+{
+    if (nstages > stages_cap)
     {
-        pid_t id = atoi(command->argv[1]);
+        stages_cap = nstages * 2;
+        stages = realloc(stages, stages_cap * sizeof(*stages));
+    }
 
-        if (jid2job[id] == NULL)
+    bool found = true;
+    size_t used = 0;
+    for (size_t i = 0; i < nstages; i++)
+    {
+        struct ast_command *command = &pipee->cmdv[i];
+        char *name = command->argv[0];
+        stages[i].argv = command->argv;
+        stages[i].flags = command->dup_stderr_to_stdout ? POSIX_SPAWN_STAGE_STDERR : 0;
+        stages[i].fn = NULL;
+        stages[i].envp = NULL;
+
+        const struct builtin *b = find_builtin(name);
+        if (b && !(b->flags & BUILTIN_PIPELINE))
         {
-            printf("JOB DOESNT EXIST\n");
+            fprintf(stderr, "%s: cannot be used in a pipeline\n", name);
+            found = false;
+            continue;
         }
-        else
+        if (b)
         {
-            struct job *sjob = jid2job[id];
-
-            if (sjob == NULL)
-            {
-                printf("Error error");
-            }
-            else if (sjob->jid == id)
-            {
-                struct termios *state = NULL;
-                if (sjob->status != BACKGROUND)
-                {
-                    state = &sjob->saved_tty_state;
-                }
-                sjob->status = FOREGROUND;
-                print_cmdline(sjob->pipe);
-                printf("\n");
-
-                termstate_give_terminal_to(state, sjob->pgid);
-                if (killpg(sjob->pgid, SIGCONT))
-                {
-                    utils_error("Error sending SIGCONT in fg");
-                }
-                wait_for_job(sjob);
-                termstate_give_terminal_back_to_shell();
-            }
+            stages[i].fn = run_builtin_child;
+            continue;
         }
-        ast_pipeline_free(pipee);
-    }
-    else if (strcmp(command->argv[0], "stop") == 0)
-    {
-        pid_t id = atoi(command->argv[1]);
 
-        if (jid2job[id] == NULL)
+        const char *path = strchr(name, '/') ? name : command_hash_lookup(name);
+        if (path == NULL)
         {
-            printf("JOB DOESNT EXIST\n");
+            errno = ENOENT;
+            utils_error("%s: ", name);
+            found = false;
+            continue;
         }
-        else
-        {
-            struct job *sjob = jid2job[id];
 
-            if (sjob == NULL)
-            {
-                printf("Error error");
-            }
-            else if (sjob->jid == id)
-            {
-                sjob->status = STOPPED;
-                if (killpg(sjob->pgid, SIGSTOP))
-                {
-                    utils_error("Error dending SIGSTOP in stop");
-                }
-                termstate_give_terminal_back_to_shell();
-            }
+        size_t len = strlen(path) + 1;
+        if (used + len > stage_paths_cap)
+        {
+            stage_paths_cap = (used + len) * 2;
+            stage_paths = realloc(stage_paths, stage_paths_cap);
         }
-        ast_pipeline_free(pipee);
+        memcpy(stage_paths + used, path, len);
+        used += len;
     }
-    else if (strcmp(command->argv[0], "kill") == 0)
+    if (!found)
     {
-        pid_t id = atoi(command->argv[1]);
+        return false;
+    }
 
-        if (jid2job[id] == NULL)
-        {
-            printf("JOB DOESNT EXIST\n");
-        }
-        else
+    // stage_paths no longer moves, so the paths can be pointed at now;
+    // 'NAME=value command' gets the environment with NAME layered on
+    char *p = stage_paths;
+    for (size_t i = 0; i < nstages; i++)
+    {
+        if (stages[i].fn == NULL)
         {
-            struct job *sjob = jid2job[id];
-
-            if (sjob == NULL)
-            {
-                printf("Error error");
-            }
-            else if (sjob->jid == id)
+            stages[i].path = p;
+            p += strlen(p) + 1;
+            if (pipee->cmdv[i].assignments)
             {
-                if (killpg(sjob->pgid, SIGKILL))
-                {
-                    utils_error("Error sending SIGKILL in kill");
-                }
-                termstate_give_terminal_back_to_shell();
+                stages[i].envp = variables_environ_with(pipee->cmdv[i].assignments);
             }
         }
-        ast_pipeline_free(pipee);
     }
-    else if (strcmp(command->argv[0], "cd") == 0)
+    return true;
+}
+
+/* Free the layered environments prepare_stages made */
+static void free_stage_environs(size_t nstages)
+{
+    for (size_t i = 0; i < nstages; i++)
     {
-        char *path = command->argv[1];
-        if (!path)
-        {
-            path = getenv("HOME");
-        }
-        if (chdir(path) == -1)
-        {
-            utils_error("cd: %s: No such file or directory\n", path);
-        }
-        ast_pipeline_free(pipee);
+        free((char **)stages[i].envp);
+        stages[i].envp = NULL;
     }
-    else if (strcmp(command->argv[0], "history") == 0)
-    {
-        // Display the command history
-        HIST_ENTRY **histList = history_list();
-        int history_len = history_length;
+}
 
-        for (int i = 0; i < history_len; i++)
+/**
+ * After a spawn failed with ENOENT, forget remembered locations whose
+ * file went away.  Returns true if any entry was forgotten.
+ */
+static bool forget_stale_stages(size_t nstages)
+{
+    bool stale = false;
+    for (size_t i = 0; i < nstages; i++)
+    {
+        char *name = stages[i].argv[0];
+        if (stages[i].error == ENOENT && stages[i].fn == NULL && !strchr(name, '/') &&
+            access(stages[i].path, X_OK) != 0)
         {
-            printf("  %d %s\n", i + 1, histList[i]->line);
+            command_hash_remove(name);
+            stale = true;
         }
-        ast_pipeline_free(pipee);
-    }
-
-    else
-    {
-        non_built_in(pipee, command);
     }
+    return stale;
 }
 
 /**
- * Handles non built in commands given to the command line
+ * Handles non built in commands given to the command line.
+ * Returns the exit status of a foreground job, 0 for a background job.
  */
-static void non_built_in(struct ast_pipeline *pipee, struct ast_command *command)
+static int non_built_in(struct ast_pipeline *pipee)
 {
-    struct job *cur_job = add_job(pipee);
+    // a builtin at the end of the pipeline runs in the shell itself,
+    // reading from the stages before it, which are spawned as usual
+    size_t nstages = pipee->ncmds;
+    struct ast_command *last = &pipee->cmdv[nstages - 1];
+    const struct builtin *last_builtin = find_builtin(last->argv[0]);
+    if (last_builtin)
+    {
+        nstages--;
+    }
+    // a lone builtin leaves nothing to spawn
+    if (nstages == 0)
+    {
+        return exe_pipelines(pipee);
+    }
 
-    posix_spawn_file_actions_t child_file_attr;
-    posix_spawnattr_t child_spawn_attr;
+    struct job *cur_job = add_job(pipee);
+    if (cur_job == NULL)
+    {
+        return 1;
+    }
 
-    if (posix_spawn_file_actions_init(&child_file_attr))
+    cur_job->PID_list = create_PIDs(nstages);
+    if (!prepare_stages(pipee, nstages))
+    {
+        list_remove(&cur_job->elem);
+        delete_job(cur_job);
+        return 127;
+    }
+    int here_fd = -1;
+    if (pipee->here && (here_fd = here_text_fd(pipee->here, pipee->nhere)) < 0)
     {
-        utils_error("Error initializing child file attr");
+        free_stage_environs(nstages);
+        list_remove(&cur_job->elem);
+        delete_job(cur_job);
+        return 1;
     }
+
+    posix_spawnattr_t child_spawn_attr;
     if (posix_spawnattr_init(&child_spawn_attr))
     {
         utils_error("Error initializing child spawn attr");
     }
 
-    // posix_spawnattr_setflags // flags will defer depending on if the job is foreground or background
-    //  if its a foreground setpgroup and tcsetgroup
-    // posix_spawnattr_tc
-
-    // posix spawnattr tcsetpgrp np; use this to give child terminal access
-    //  takes two different agrumetnts, child and file descriptor look for termstat state tty ft only for foreground
-
-    // new process sets gpid as its own pid
-    pid_t gpid;
-    if (posix_spawnattr_setpgroup(&child_spawn_attr, 0))
+    // the shell keeps SIGCHLD blocked; children start with nothing blocked
+    sigset_t empty_mask;
+    sigemptyset(&empty_mask);
+    if (posix_spawnattr_setsigmask(&child_spawn_attr, &empty_mask))
     {
-        utils_error("Error storing child spawn attr pgroup");
+        utils_error("Error setting child signal mask");
     }
 
-    // set up for foreground process
-    if (!pipee->bg_job)
+    // with job control, all stages join one new process group and a
+    // foreground job also takes the terminal, which the group leader
+    // does on its way in
+    short flags = POSIX_SPAWN_SETSIGMASK;
+    if (interactive)
+    {
+        flags |= POSIX_SPAWN_SETPGROUP;
+    }
+    if (!pipee->bg_job && interactive)
     {
         if (posix_spawnattr_tcsetpgrp_np(&child_spawn_attr, termstate_get_tty_fd()))
         {
             utils_error("Error in terminal access setup");
         }
+        flags |= POSIX_SPAWN_TCSETPGROUP;
+    }
+    cur_job->status = pipee->bg_job ? BACKGROUND : FOREGROUND;
+    if (posix_spawnattr_setflags(&child_spawn_attr, flags))
+    {
+        utils_error("Error could not set proper flags for child spawn attr");
+    }
 
-        if (posix_spawnattr_setflags(&child_spawn_attr, POSIX_SPAWN_SETPGROUP | POSIX_SPAWN_USEVFORK | POSIX_SPAWN_TCSETPGROUP))
+    struct posix_spawn_pipeline_io io = {
+        .infile = pipee->iored_input,
+        .infd = here_fd,
+        .outfile = pipee->iored_output,
+        .outflags = pipee->append_to_output ? O_APPEND : O_TRUNC,
+        .outfd = -1,
+    };
+    if (pipee->iored_output && pipee->append_to_output && cache_appends)
+    {
+        io.outfd = append_cache_get(pipee->iored_output);
+        if (io.outfd >= 0)
         {
-            utils_error("Error could not set proper flags for child spawn attr");
+            io.outfile = NULL;
         }
-        cur_job->status = FOREGROUND;
     }
-    else
+    int last_pipe[2] = {-1, -1};
+    if (last_builtin)
     {
-        if (posix_spawnattr_setflags(&child_spawn_attr, POSIX_SPAWN_SETPGROUP | POSIX_SPAWN_USEVFORK))
+        if (pipe2(last_pipe, O_CLOEXEC) != 0)
         {
-            utils_error("Error could not set proper flags for child spawn attr");
+            utils_fatal_error("Error creating pipe");
         }
-        cur_job->status = BACKGROUND;
+        io.outfile = NULL;
+        io.outfd = last_pipe[1];
     }
 
-    // Manages of the input pipe
-    if (pipee->iored_input)
+    // forked builtins must not inherit output the shell has not written yet
+    fflush(stdout);
+    builtin_job = cur_job;
+    int rc = posix_spawn_pipeline(stages, nstages, &io, &child_spawn_attr, variables_environ());
+
+    // if a remembered file went away before anything started, search $PATH once more
+    bool started = false;
+    for (size_t i = 0; i < nstages; i++)
     {
-        if (posix_spawn_file_actions_addopen(&child_file_attr, fileno(stdin), pipee->iored_input, O_RDWR, 0666))
+        started |= stages[i].pid != -1;
+    }
+    if (rc == ENOENT && !started && forget_stale_stages(nstages))
+    {
+        free_stage_environs(nstages);
+        if (prepare_stages(pipee, nstages))
         {
-            utils_error("Error chould not open child file arrt I/O");
+            posix_spawn_pipeline(stages, nstages, &io, &child_spawn_attr, variables_environ());
         }
     }
-
-    // set up pipes
-    // get the number of pipes
-    int num_pipes = list_size(&pipee->commands) - 1;
-    if (num_pipes == 0)
+    free_stage_environs(nstages);
+    if (here_fd >= 0)
     {
-        cur_job->PID_list = create_PIDs(1);
+        close(here_fd);
     }
-    else
+
+    if (posix_spawnattr_destroy(&child_spawn_attr))
     {
-        cur_job->PID_list = create_PIDs(num_pipes);
+        utils_error("Error destroying attr");
     }
 
-    // create an array for the pipes
-    int *pipe_array = NULL;
-    int index = 0;
-    // if needed to pipe, wire stdin and stdout
-    if (num_pipes != 0)
+    // the stages that did start keep running, as in other shells
+    for (size_t i = 0; i < nstages; i++)
     {
-        pipe_array = calloc((num_pipes)*2, sizeof(int));
-
-        pipe2(&pipe_array[0], O_CLOEXEC);
-
-        if (posix_spawn_file_actions_adddup2(&child_file_attr, pipe_array[1], fileno(stdout)))
+        if (stages[i].pid == -1)
         {
-            utils_error("Error calling dup2 on file descriptors");
+            errno = stages[i].error;
+            utils_error("%s: ", stages[i].argv[0]);
+            continue;
         }
-        if (command->dup_stderr_to_stdout)
+        if (cur_job->num_processes_alive++ == 0)
         {
-            if (posix_spawn_file_actions_adddup2(&child_file_attr, pipe_array[1], fileno(stderr)))
-            {
-                utils_error("Error calling dup2 on file descriptors");
-            }
+            cur_job->pgid = stages[i].pid;
         }
-        index++;
+        add_PID(cur_job, stages[i].pid, stages[i].pidfd);
     }
-    // check to see if the pipe is null or only has one command. sets up pipes demendind on the current pipe state
-    else if (pipee->iored_output)
-    {
-        int term;
-        if (pipee->append_to_output)
-        {
-            term = O_APPEND;
-        }
-        else
-        {
-            term = O_TRUNC;
-        }
-        if (posix_spawn_file_actions_addopen(&child_file_attr, fileno(stdout), pipee->iored_output, O_WRONLY | term | O_CREAT, 0666))
-        {
-            utils_error("Error chould not open child file arrt I/O");
-        }
 
-        if (command->dup_stderr_to_stdout)
-        {
-            if (posix_spawn_file_actions_adddup2(&child_file_attr, fileno(stdout), fileno(stderr)))
-            {
-                utils_error("Error calling dup2 on file descriptors");
-            }
-        }
+    // the status is the last command's; 127 if it could not be started
+    int status = 127;
+    if (last_builtin)
+    {
+        close(last_pipe[1]);
+        status = run_builtin_here(last_builtin, last, NULL, last_pipe[0], pipee);
+        close(last_pipe[0]);
+    }
+    else if (nstages > 0 && stages[nstages - 1].pid != -1)
+    {
+        cur_job->last_pid = stages[nstages - 1].pid;
     }
+    builtin_job = NULL;
 
-    // create the first process, this is considered the gpid
-    // if successful, update job
-    if (posix_spawnp(&gpid, command->argv[0], &child_file_attr, &child_spawn_attr, command->argv, environ) != 0)
+    if (cur_job->num_processes_alive == 0)
     {
-        utils_error("%s: No such file or directory\n", command->argv[0]);
-        // clean the parent process attr and file
-        posix_spawn_file_actions_destroy(&child_file_attr);
-        posix_spawnattr_destroy(&child_spawn_attr);
+        list_remove(&cur_job->elem);
+        delete_job(cur_job);
+        termstate_give_terminal_back_to_shell();
+        return status;
+    }
 
-        // close the parent process pipes
-        if (pipe_array != NULL)
+    if (pipee->bg_job)
+    {
+        if (interactive)
         {
-            close(pipe_array[1]);
-            close(pipe_array[0]);
+            printf("[%d] %d\n", cur_job->jid, cur_job->pgid);
         }
+        return 0;
+    }
+
+    // wait for the job to finish
+    wait_for_job(cur_job);
+    termstate_give_terminal_back_to_shell();
+    if (cur_job->last_pid != -1)
+    {
+        status = cur_job->last_status;
+    }
 
-        struct list_elem *to_be_removed = list_back(&job_list);
-        list_remove(to_be_removed);
+    // a job the user stopped or interrupted also ends the command line
+    // it was part of, so that a loop does not carry on without it
+    if (cur_job->status == STOPPED || cur_job->status == NEEDSTERMINAL)
+    {
+        interrupted = true;
+        return 128 + SIGTSTP;
+    }
+    if (status == 128 + SIGINT || status == 128 + SIGQUIT)
+    {
+        interrupted = true;
+    }
 
+    // the job is done; remove it now rather than at the end of the line,
+    // so a long loop does not use up the job ids
+    if (cur_job->status == DELETE)
+    {
+        list_remove(&cur_job->elem);
         delete_job(cur_job);
+    }
+    return status;
+}
 
-        termstate_give_terminal_back_to_shell();
+/*
+ * chunk [-n max] [-P procs] command [arg...]
+ *
+ * Runs command as often as needed to pass it every arg without hitting
+ * ARG_MAX, like xargs: each batch is a process of one job.  The command
+ * and, if there is a "--" among its arguments, everything up to the
+ * first one are repeated in every batch.  At most procs batches run at
+ * once; the next one is started when a process of the job is reaped,
+ * so a job in the background keeps going too.
+ */
+struct chunks
+{
+    const char *path;   // the program, NULL for a builtin
+    char **prefix;      // command and its fixed arguments, in the pipeline
+    size_t nprefix;
+    char **args;        // the arguments to split, NULL terminated
+    size_t next;        // index of the first one not yet passed on
+    size_t max_args;    // -n, 0 if unlimited
+    int parallel;       // -P
+    int infd, outfd;    // the pipeline's redirections, opened once, or -1
+};
+
+static void free_chunks(struct chunks *chunks)
+{
+    if (chunks == NULL)
+    {
         return;
     }
-    else
+    if (chunks->infd >= 0)
     {
-        // printf("%d is the parent process\n", gpid);
-        add_PID(cur_job->PID_list, gpid);
-        cur_job->pgid = gpid;
-        cur_job->num_processes_alive++;
+        close(chunks->infd);
     }
-
-    // clean the parent process attr and file
-    if (posix_spawn_file_actions_destroy(&child_file_attr))
+    if (chunks->outfd >= 0)
     {
-        utils_error("Error destroying file actions");
+        close(chunks->outfd);
     }
-    if (posix_spawnattr_destroy(&child_spawn_attr))
+    free((char *)chunks->path);
+    free(chunks);
+}
+
+/* Bytes that the strings of v and the pointers to them take in execve */
+static size_t argv_bytes(char *const *v, size_t n)
+{
+    size_t bytes = 0;
+    for (size_t i = 0; i < n && v[i]; i++)
     {
-        utils_error("Error destroying attr");
+        bytes += strlen(v[i]) + 1 + sizeof(char *);
     }
+    return bytes;
+}
 
-    // close the parent process pipes
-    if (pipe_array != NULL)
+/* Spawn the next batch of a chunked job.  Returns false if there is none
+ * left or it could not be started, which ends the job's batches. */
+static bool spawn_chunk(struct job *job)
+{
+    struct chunks *chunks = job->chunks;
+    if (chunks->args[chunks->next] == NULL)
     {
-        close(pipe_array[1]);
+        return false;
     }
 
-    // create other processes
-    struct list_elem *pipeCommand = list_begin(&pipee->commands);
-    pipeCommand = list_next(pipeCommand);
+    char **assignments = job->pipe->cmdv[0].assignments;
+    char **envp = assignments ? variables_environ_with(assignments) : variables_environ();
 
-    struct list_elem *end = list_back(&pipee->commands);
-    struct ast_command *end_command = list_entry(end, struct ast_command, elem);
+    // ARG_MAX covers the environment too; keep some room like xargs does
+    long arg_max = sysconf(_SC_ARG_MAX);
+    size_t fixed = argv_bytes(envp, SIZE_MAX) + argv_bytes(chunks->prefix, chunks->nprefix) + 4096;
+    size_t budget = arg_max > 0 && (size_t)arg_max > fixed ? arg_max - fixed : 0;
 
-    // loop to go through other commands
-    while (command != end_command)
+    // always at least one argument, so one that is too long fails visibly
+    size_t n = 0, bytes = 0;
+    char **args = chunks->args + chunks->next;
+    while (args[n] && (chunks->max_args == 0 || n < chunks->max_args))
     {
-        // get the command and get next
-        command = list_entry(pipeCommand, struct ast_command, elem);
-        pipeCommand = list_next(pipeCommand);
-
-        // set up for spawning new process
-        pid_t spawnPID;
-        posix_spawn_file_actions_t child_file_attr;
-        posix_spawnattr_t child_spawn_attr;
-
-        if (posix_spawn_file_actions_init(&child_file_attr) != 0)
+        size_t more = strlen(args[n]) + 1 + sizeof(char *);
+        if (n > 0 && bytes + more > budget)
         {
-            utils_error("failure initalizing file actions");
-        }
-        if (posix_spawnattr_init(&child_spawn_attr))
-        {
-            utils_error("failure initalizing child spawn attr");
+            break;
         }
+        bytes += more;
+        n++;
+    }
 
-        // set gpid
-        if (posix_spawnattr_setpgroup(&child_spawn_attr, gpid))
-        {
-            utils_error("Error setting pgroup");
-        }
-        if (posix_spawnattr_setflags(&child_spawn_attr, POSIX_SPAWN_SETPGROUP))
+    char **argv = malloc((chunks->nprefix + n + 1) * sizeof(*argv));
+    memcpy(argv, chunks->prefix, chunks->nprefix * sizeof(*argv));
+    memcpy(argv + chunks->nprefix, args, n * sizeof(*argv));
+    argv[chunks->nprefix + n] = NULL;
+    chunks->next += n;
+
+    struct posix_spawn_stage stage = {
+        .path = chunks->path,
+        .argv = argv,
+        .flags = job->pipe->cmdv[0].dup_stderr_to_stdout ? POSIX_SPAWN_STAGE_STDERR : 0,
+        .fn = chunks->path ? NULL : run_builtin_child,
+        .envp = envp,
+    };
+    struct posix_spawn_pipeline_io io = {
+        .infd = chunks->infd,
+        .outfd = chunks->outfd,
+    };
+
+    // a batch joins the processes of the job that are still around; once
+    // all are gone the group is gone too, and the batch starts a new one
+    posix_spawnattr_t attr;
+    posix_spawnattr_init(&attr);
+    sigset_t empty_mask;
+    sigemptyset(&empty_mask);
+    posix_spawnattr_setsigmask(&attr, &empty_mask);
+    short flags = POSIX_SPAWN_SETSIGMASK;
+    if (interactive)
+    {
+        flags |= POSIX_SPAWN_SETPGROUP;
+        posix_spawnattr_setpgroup(&attr, job->num_processes_alive > 0 ? job->pgid : 0);
+    }
+    if (interactive && job->status == FOREGROUND && job->num_processes_alive == 0)
+    {
+        posix_spawnattr_tcsetpgrp_np(&attr, termstate_get_tty_fd());
+        flags |= POSIX_SPAWN_TCSETPGROUP;
+    }
+    posix_spawnattr_setflags(&attr, flags);
+
+    fflush(stdout);
+    posix_spawn_pipeline(&stage, 1, &io, &attr, variables_environ());
+    posix_spawnattr_destroy(&attr);
+    free(argv);
+    if (assignments)
+    {
+        free(envp);
+    }
+
+    if (stage.pid == -1)
+    {
+        errno = stage.error;
+        utils_error("%s: ", chunks->prefix[0]);
+        job->last_status = 127;
+        while (chunks->args[chunks->next] != NULL)
         {
-            utils_error("Error setting flags");
+            chunks->next++;
         }
+        return false;
+    }
+    if (job->num_processes_alive++ == 0)
+    {
+        job->pgid = stage.pid;
+    }
+    add_PID(job, stage.pid, stage.pidfd);
+    return true;
+}
+
+/* Start batches of a chunked job until -P of them are running */
+static void run_chunks(struct job *job)
+{
+    while (job->num_processes_alive < job->chunks->parallel && spawn_chunk(job))
+    {
+    }
+}
 
-        // get where the pipes input and output are going to be in the pipe array
-        int input = (index - 1) * 2;
-        int output = (index * 2) + 1;
+/* Parse a count given to an option of chunk; 0 if it is not positive */
+static size_t chunk_count(const char *s)
+{
+    char *end;
+    long n = s ? strtol(s, &end, 10) : 0;
+    return s && *s && *end == '\0' && n > 0 ? n : 0;
+}
+
+/**
+ * Run a pipeline that is 'chunk ...' on its own.
+ * Returns the exit status of the first batch that failed, 0 if none did
+ * or the job runs in the background.
+ */
+static int run_chunked(struct ast_pipeline *pipee)
+{
+    char **argv = pipee->cmdv[0].argv;
+    struct chunks *chunks = calloc(1, sizeof(*chunks));
+    chunks->parallel = 1;
+    chunks->infd = chunks->outfd = -1;
 
-        // wire process inputs
-        if (posix_spawn_file_actions_adddup2(&child_file_attr, pipe_array[input], fileno(stdin)))
+    size_t i = 1;
+    while (argv[i] && argv[i][0] == '-')
+    {
+        size_t n = chunk_count(argv[i + 1]);
+        if (strcmp(argv[i], "-n") == 0 && n)
         {
-            utils_error("Error calling dup2 on file descriptors");
+            chunks->max_args = n;
         }
-
-        // if not the last command, then need to wire to other pipe
-        if (command != end_command)
+        else if (strcmp(argv[i], "-P") == 0 && n)
         {
-            // printf("Current pipes input: %d, output: %d being wired to: %d\n", input, output, (index * 2));
-            pipe2(&pipe_array[index * 2], O_CLOEXEC);
-            if (posix_spawn_file_actions_adddup2(&child_file_attr, pipe_array[output], fileno(stdout)))
-            {
-                utils_error("Error calling dup2 on file descriptors");
-            }
-            if (command->dup_stderr_to_stdout)
-            {
-                if (posix_spawn_file_actions_adddup2(&child_file_attr, pipe_array[output], fileno(stderr)))
-                {
-                    utils_error("Error calling dup2 on file descriptors");
-                }
-            }
-            index++;
+            chunks->parallel = n < 64 ? n : 64;
         }
-        else if (pipee->iored_output)
+        else
         {
-            int term;
-            if (pipee->append_to_output)
-            {
-                term = O_APPEND;
-            }
-            else
-            {
-                term = O_TRUNC;
-            }
-            if (posix_spawn_file_actions_addopen(&child_file_attr, fileno(stdout), pipee->iored_output, O_WRONLY | term | O_CREAT, 0666))
-            {
-                utils_error("Error opening file actions");
-            }
-
-            if (command->dup_stderr_to_stdout)
-            {
-                if (posix_spawn_file_actions_adddup2(&child_file_attr, fileno(stdout), fileno(stderr)))
-                {
-                    utils_error("Error calling dup2 on file descriptors");
-                }
-            }
+            break;
         }
+        i += 2;
+    }
+    if (argv[i] == NULL || argv[i][0] == '-')
+    {
+        fprintf(stderr, "chunk: usage: chunk [-n max] [-P procs] command [arg...]\n");
+        free_chunks(chunks);
+        return 2;
+    }
 
-        // if spawn successful, update job
-        if (posix_spawnp(&spawnPID, command->argv[0], &child_file_attr, &child_spawn_attr, command->argv, environ))
+    chunks->prefix = argv + i;
+    chunks->nprefix = 1;
+    for (size_t j = 1; chunks->prefix[j]; j++)
+    {
+        if (strcmp(chunks->prefix[j], "--") == 0)
         {
-            utils_error("%s: No such file or directory\n", command->argv[0]);
-            // clean the parent process attr and file
-            posix_spawn_file_actions_destroy(&child_file_attr);
-            posix_spawnattr_destroy(&child_spawn_attr);
-
-            struct list_elem *to_be_removed = list_back(&job_list);
-            list_remove(to_be_removed);
-
-            delete_job(cur_job);
-
-            termstate_give_terminal_back_to_shell();
-            return;
+            chunks->nprefix = j + 1;
+            break;
         }
-        else
+    }
+    chunks->args = chunks->prefix + chunks->nprefix;
+
+    char *name = chunks->prefix[0];
+    const struct builtin *b = find_builtin(name);
+    if (b && !(b->flags & BUILTIN_PIPELINE))
+    {
+        fprintf(stderr, "chunk: %s: cannot be run in batches\n", name);
+        free_chunks(chunks);
+        return 2;
+    }
+    if (b == NULL)
+    {
+        const char *path = strchr(name, '/') ? name : command_hash_lookup(name);
+        if (path == NULL)
         {
-            cur_job->num_processes_alive++;
-            add_PID(cur_job->PID_list, spawnPID);
-            // printf("%d is the child process\n", spawnPID);
+            errno = ENOENT;
+            utils_error("%s: ", name);
+            free_chunks(chunks);
+            return 127;
         }
+        chunks->path = strdup(path);
+    }
 
-        // clean the process attr and file
-        if (posix_spawnattr_destroy(&child_spawn_attr))
+    // every batch shares one opening of each file, so > truncates it once
+    if (pipee->here)
+    {
+        chunks->infd = here_text_fd(pipee->here, pipee->nhere);
+        if (chunks->infd < 0)
         {
-            utils_error("Error destroying attr");
+            free_chunks(chunks);
+            return 1;
         }
-        if (posix_spawn_file_actions_destroy(&child_file_attr))
+    }
+    if (pipee->iored_input)
+    {
+        chunks->infd = open(pipee->iored_input, O_RDONLY | O_CLOEXEC);
+        if (chunks->infd < 0)
         {
-            utils_error("Error destroying file actions");
+            utils_error("%s: ", pipee->iored_input);
+            free_chunks(chunks);
+            return 1;
         }
-
-        // close pipes after use
-        close(pipe_array[input]);
-        if (command != end_command)
+    }
+    if (pipee->iored_output)
+    {
+        int term = pipee->append_to_output ? O_APPEND : O_TRUNC;
+        chunks->outfd = open(pipee->iored_output, O_WRONLY | O_CREAT | O_CLOEXEC | term, 0666);
+        if (chunks->outfd < 0)
         {
-            close(pipe_array[output]);
+            utils_error("%s: ", pipee->iored_output);
+            free_chunks(chunks);
+            return 1;
         }
     }
 
-    // wait for the job to finish
-    if (!pipee->bg_job)
+    struct job *cur_job = add_job(pipee);
+    if (cur_job == NULL)
+    {
+        free_chunks(chunks);
+        return 1;
+    }
+
+    // the PID list grows as batches are started
+    cur_job->PID_list = create_PIDs(chunks->parallel);
+    cur_job->chunks = chunks;
+    cur_job->status = pipee->bg_job ? BACKGROUND : FOREGROUND;
+    run_chunks(cur_job);
+
+    if (cur_job->num_processes_alive == 0)
     {
-        wait_for_job(cur_job);
+        int status = cur_job->last_status;
+        list_remove(&cur_job->elem);
+        delete_job(cur_job);
         termstate_give_terminal_back_to_shell();
+        return status;
     }
-    else
+
+    if (pipee->bg_job)
     {
-        printf("[%d] %d\n", cur_job->jid, cur_job->pgid);
+        if (interactive)
+        {
+            printf("[%d] %d\n", cur_job->jid, cur_job->pgid);
+        }
+        return 0;
     }
 
-    // clean the pipe array after use
-    if (pipe_array)
+    wait_for_job(cur_job);
+    termstate_give_terminal_back_to_shell();
+    int status = cur_job->last_status;
+
+    if (cur_job->status == STOPPED || cur_job->status == NEEDSTERMINAL)
+    {
+        interrupted = true;
+        return 128 + SIGTSTP;
+    }
+    if (status == 128 + SIGINT || status == 128 + SIGQUIT)
+    {
+        interrupted = true;
+    }
+    if (cur_job->status == DELETE)
     {
-        free(pipe_array);
+        list_remove(&cur_job->elem);
+        delete_job(cur_job);
     }
+    return status;
 }
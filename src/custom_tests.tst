@@ -1,3 +1,15 @@
 = Custom tests
 10 cd_test.py
-10 history_test.py
\ No newline at end of file
+10 history_test.py
+10 hash_test.py
+10 builtin_pipe_test.py
+10 utility_builtins_test.py
+10 parse_cache_test.py
+10 script_mode_test.py
+10 control_flow_test.py
+10 variables_test.py
+10 gback_glob_test.py
+10 glob_recursive_test.py
+10 chunk_test.py
+10 append_cache_test.py
+10 heredoc_test.py
\ No newline at end of file
@@ -0,0 +1,504 @@
+/*
+ * Pathname expansion with a cache of directory listings.
+ *
+ * A pattern is expanded component by component.  Leading components
+ * without wildcards are taken as they are; a component with wildcards
+ * is matched with fnmatch against the listing of the directory it is
+ * in.  Listings come from a chained hash table keyed by directory; a
+ * miss reads the directory with getdents64 into one block of names
+ * plus an array of (offset, d_type) entries, so most matches need no
+ * stat at all.
+ *
+ * '**' first collects every directory below its base.  The walk is a
+ * queue of directories still to be read; it starts on the calling
+ * thread, and once more than WALK_PARALLEL_MIN directories are waiting
+ * a few helper threads take from the queue too.  The listings they
+ * read go into the cache, where the rest of the pattern finds them.
+ * Results are sorted at the end, so the order in which the threads
+ * ran does not show.
+ */
+#define _GNU_SOURCE 1
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <fnmatch.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "glob_expand.h"
+
+struct entry
+{
+    uint32_t name;              /* Offset into the listing's names */
+    unsigned char type;         /* DT_* from getdents64 */
+};
+
+struct listing
+{
+    struct listing *next;       /* Next listing in the same bucket */
+    uint32_t hash;
+    char *dir;                  /* "" for the current directory, else
+                                   ending in '/' */
+    char *names;                /* The names, each NUL terminated */
+    struct entry *entries;      /* Without . and .. */
+    size_t nentries;
+};
+
+struct glob_cache
+{
+    pthread_mutex_t lock;       /* Protects the table while walkers add to it */
+    struct listing **buckets;
+    size_t nbuckets, nlistings;
+};
+
+/* A growable array of malloc'd paths */
+struct paths
+{
+    char **v;
+    size_t n, cap;
+};
+
+#define INITIAL_BUCKETS 64
+#define DENTS_BUFFER 32768
+#define WALK_PARALLEL_MIN 32    /* Directories waiting before helpers start */
+#define WALK_MAX_THREADS 4      /* Including the calling thread */
+
+/* FNV-1a */
+static uint32_t
+hash_string(const char *s)
+{
+    uint32_t h = 2166136261u;
+    while (*s)
+    {
+        h ^= (unsigned char)*s++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static void
+add_path(struct paths *paths, char *path)
+{
+    if (paths->n == paths->cap)
+    {
+        paths->cap = paths->cap ? 2 * paths->cap : 16;
+        paths->v = realloc(paths->v, paths->cap * sizeof *paths->v);
+    }
+    paths->v[paths->n++] = path;
+}
+
+/* Return malloc'd a + b + c */
+static char *
+join(const char *a, const char *b, const char *c)
+{
+    size_t la = strlen(a), lb = strlen(b), lc = strlen(c);
+    char *s = malloc(la + lb + lc + 1);
+    memcpy(s, a, la);
+    memcpy(s + la, b, lb);
+    memcpy(s + la + lb, c, lc + 1);
+    return s;
+}
+
+/* ---- the cache ---- */
+
+struct glob_cache *
+glob_cache_create(void)
+{
+    struct glob_cache *cache = calloc(1, sizeof *cache);
+    pthread_mutex_init(&cache->lock, NULL);
+    return cache;
+}
+
+static void
+free_listing(struct listing *l)
+{
+    free(l->dir);
+    free(l->names);
+    free(l->entries);
+    free(l);
+}
+
+void
+glob_cache_clear(struct glob_cache *cache)
+{
+    if (cache->nlistings == 0)
+        return;
+
+    for (size_t i = 0; i < cache->nbuckets; i++)
+    {
+        for (struct listing *l = cache->buckets[i], *next; l; l = next)
+        {
+            next = l->next;
+            free_listing(l);
+        }
+        cache->buckets[i] = NULL;
+    }
+    cache->nlistings = 0;
+}
+
+void
+glob_cache_destroy(struct glob_cache *cache)
+{
+    glob_cache_clear(cache);
+    pthread_mutex_destroy(&cache->lock);
+    free(cache->buckets);
+    free(cache);
+}
+
+/* Read a directory; one that cannot be read is listed as empty */
+static struct listing *
+read_listing(const char *dir)
+{
+    struct listing *l = calloc(1, sizeof *l);
+    l->dir = strdup(dir);
+
+    int fd = open(*dir ? dir : ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd == -1)
+        return l;
+
+    size_t names_len = 0, names_cap = 0, entries_cap = 0;
+    char *buf = malloc(DENTS_BUFFER);
+    ssize_t n;
+    while ((n = getdents64(fd, buf, DENTS_BUFFER)) > 0)
+    {
+        for (ssize_t off = 0; off < n; )
+        {
+            struct dirent64 *d = (struct dirent64 *)(buf + off);
+            off += d->d_reclen;
+
+            const char *name = d->d_name;
+            if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+                continue;
+
+            size_t len = strlen(name) + 1;
+            if (names_len + len > names_cap)
+            {
+                names_cap = names_cap ? 2 * names_cap : 4096;
+                while (names_len + len > names_cap)
+                    names_cap *= 2;
+                l->names = realloc(l->names, names_cap);
+            }
+            if (l->nentries == entries_cap)
+            {
+                entries_cap = entries_cap ? 2 * entries_cap : 64;
+                l->entries = realloc(l->entries, entries_cap * sizeof *l->entries);
+            }
+            memcpy(l->names + names_len, name, len);
+            l->entries[l->nentries++] = (struct entry) { names_len, d->d_type };
+            names_len += len;
+        }
+    }
+    free(buf);
+    close(fd);
+    return l;
+}
+
+static struct listing *
+find_listing(struct glob_cache *cache, const char *dir, uint32_t h)
+{
+    if (cache->buckets == NULL)
+        return NULL;
+    for (struct listing *l = cache->buckets[h & (cache->nbuckets - 1)]; l; l = l->next)
+        if (l->hash == h && strcmp(l->dir, dir) == 0)
+            return l;
+    return NULL;
+}
+
+/* Double the bucket array once the load factor exceeds 3/4 */
+static void
+maybe_grow(struct glob_cache *cache)
+{
+    if (cache->buckets != NULL && cache->nlistings * 4 < cache->nbuckets * 3)
+        return;
+
+    size_t newsize = cache->buckets ? cache->nbuckets * 2 : INITIAL_BUCKETS;
+    struct listing **newbuckets = calloc(newsize, sizeof *newbuckets);
+    for (size_t i = 0; i < cache->nbuckets; i++)
+    {
+        for (struct listing *l = cache->buckets[i], *next; l; l = next)
+        {
+            next = l->next;
+            struct listing **b = &newbuckets[l->hash & (newsize - 1)];
+            l->next = *b;
+            *b = l;
+        }
+    }
+    free(cache->buckets);
+    cache->buckets = newbuckets;
+    cache->nbuckets = newsize;
+}
+
+/* Return the listing of 'dir', reading it if it is not cached.  The
+ * directory is read without holding the lock, so walkers read in
+ * parallel. */
+static struct listing *
+get_listing(struct glob_cache *cache, const char *dir)
+{
+    uint32_t h = hash_string(dir);
+    pthread_mutex_lock(&cache->lock);
+    struct listing *l = find_listing(cache, dir, h);
+    pthread_mutex_unlock(&cache->lock);
+    if (l != NULL)
+        return l;
+
+    struct listing *fresh = read_listing(dir);
+    fresh->hash = h;
+    pthread_mutex_lock(&cache->lock);
+    l = find_listing(cache, dir, h);
+    if (l == NULL)
+    {
+        maybe_grow(cache);
+        struct listing **b = &cache->buckets[h & (cache->nbuckets - 1)];
+        fresh->next = *b;
+        *b = fresh;
+        cache->nlistings++;
+        l = fresh;
+        fresh = NULL;
+    }
+    pthread_mutex_unlock(&cache->lock);
+    if (fresh != NULL)
+        free_listing(fresh);
+    return l;
+}
+
+/* Whether an entry is a directory, following a symbolic link if 'follow' */
+static bool
+entry_is_dir(struct listing *l, struct entry *e, bool follow)
+{
+    if (e->type == DT_DIR)
+        return true;
+    if (e->type != DT_UNKNOWN && !(follow && e->type == DT_LNK))
+        return false;
+
+    char *path = join(l->dir, l->names + e->name, "");
+    struct stat st;
+    int rc = follow ? stat(path, &st) : lstat(path, &st);
+    free(path);
+    return rc == 0 && S_ISDIR(st.st_mode);
+}
+
+/* ---- walking a tree for ** ---- */
+
+struct walk
+{
+    struct glob_cache *cache;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;     /* Directories were queued, or all are done */
+    struct paths dirs;          /* Every directory found; those from 'next'
+                                   on are still to be read */
+    size_t next;
+    int busy;                   /* Threads reading a directory */
+    pthread_t helpers[WALK_MAX_THREADS - 1];
+    int nhelpers;
+    bool started;
+};
+
+static void walk_run(struct walk *w, bool is_main);
+
+static void *
+walk_helper(void *arg)
+{
+    walk_run(arg, false);
+    return NULL;
+}
+
+/* Called with w->lock held */
+static void
+start_helpers(struct walk *w)
+{
+    long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+    /* directory reads block on the disk, so even one CPU gets a helper */
+    int nthreads = ncpus < 2 ? 2 : ncpus > WALK_MAX_THREADS ? WALK_MAX_THREADS : ncpus;
+    w->started = true;
+    for (int i = 0; i < nthreads - 1; i++)
+        if (pthread_create(&w->helpers[w->nhelpers], NULL, walk_helper, w) == 0)
+            w->nhelpers++;
+}
+
+static void
+walk_run(struct walk *w, bool is_main)
+{
+    pthread_mutex_lock(&w->lock);
+    for (;;)
+    {
+        while (w->next == w->dirs.n && w->busy > 0)
+            pthread_cond_wait(&w->changed, &w->lock);
+        if (w->next == w->dirs.n)
+            break;
+
+        char *dir = w->dirs.v[w->next++];
+        w->busy++;
+        pthread_mutex_unlock(&w->lock);
+
+        struct listing *l = get_listing(w->cache, dir);
+        struct paths found = { NULL, 0, 0 };
+        for (size_t i = 0; i < l->nentries; i++)
+        {
+            struct entry *e = &l->entries[i];
+            if (l->names[e->name] != '.' && entry_is_dir(l, e, false))
+                add_path(&found, join(dir, l->names + e->name, "/"));
+        }
+
+        pthread_mutex_lock(&w->lock);
+        for (size_t i = 0; i < found.n; i++)
+            add_path(&w->dirs, found.v[i]);
+        free(found.v);
+        w->busy--;
+        if (is_main && !w->started && w->dirs.n - w->next >= WALK_PARALLEL_MIN)
+            start_helpers(w);
+        if (found.n > 0 || w->busy == 0)
+            pthread_cond_broadcast(&w->changed);
+    }
+    pthread_cond_broadcast(&w->changed);
+    pthread_mutex_unlock(&w->lock);
+}
+
+/* Return 'base' and every directory below it, each ending in '/'
+ * (except an empty base) */
+static struct paths
+walk_tree(struct glob_cache *cache, const char *base)
+{
+    struct walk w;
+    memset(&w, 0, sizeof w);
+    w.cache = cache;
+    pthread_mutex_init(&w.lock, NULL);
+    pthread_cond_init(&w.changed, NULL);
+    add_path(&w.dirs, strdup(base));
+
+    walk_run(&w, true);
+    for (int i = 0; i < w.nhelpers; i++)
+        pthread_join(w.helpers[i], NULL);
+
+    pthread_cond_destroy(&w.changed);
+    pthread_mutex_destroy(&w.lock);
+    return w.dirs;
+}
+
+/* ---- matching ---- */
+
+bool
+glob_is_pattern(const char *word)
+{
+    for (const char *p = word; *p; p++)
+    {
+        if (*p == '*' || *p == '?')
+            return true;
+        /* a lone '[', as in the test command, is not a pattern */
+        if (*p == '[' && p[1] != '\0' && strchr(p + 2, ']'))
+            return true;
+    }
+    return false;
+}
+
+static bool
+exists(const char *path, bool need_dir)
+{
+    struct stat st;
+    if (need_dir)
+        return stat(path, &st) == 0 && S_ISDIR(st.st_mode);
+    return lstat(path, &st) == 0;
+}
+
+/* Add the paths in 'dir' that match 'rest' to 'out' */
+static void
+expand(struct glob_cache *cache, const char *dir, const char *rest, struct paths *out)
+{
+    while (*rest == '/')
+        rest++;
+    if (*rest == '\0')
+    {
+        /* the pattern ended in a slash: only directories match */
+        if (*dir && exists(dir, true))
+            add_path(out, strdup(dir));
+        return;
+    }
+
+    const char *end = strchrnul(rest, '/');
+    size_t len = end - rest;
+    char seg[len + 1];
+    memcpy(seg, rest, len);
+    seg[len] = '\0';
+
+    if (strcmp(seg, "**") == 0)
+    {
+        struct paths dirs = walk_tree(cache, dir);
+        for (size_t i = 0; i < dirs.n; i++)
+        {
+            /* a final ** matches everything below, as ** followed by * would */
+            expand(cache, dirs.v[i], *end ? end + 1 : "*", out);
+            free(dirs.v[i]);
+        }
+        free(dirs.v);
+        return;
+    }
+
+    if (!glob_is_pattern(seg))
+    {
+        char *path = join(dir, seg, *end ? "/" : "");
+        if (*end)
+            expand(cache, path, end + 1, out);
+        else if (exists(path, false))
+        {
+            add_path(out, path);
+            path = NULL;
+        }
+        free(path);
+        return;
+    }
+
+    struct listing *l = get_listing(cache, dir);
+    for (size_t i = 0; i < l->nentries; i++)
+    {
+        struct entry *e = &l->entries[i];
+        const char *name = l->names + e->name;
+        if (fnmatch(seg, name, FNM_PERIOD) != 0)
+            continue;
+        if (*end == '\0')
+            add_path(out, join(dir, name, ""));
+        else if (entry_is_dir(l, e, true))
+        {
+            char *sub = join(dir, name, "/");
+            expand(cache, sub, end + 1, out);
+            free(sub);
+        }
+    }
+}
+
+static int
+compare_paths(const void *a, const void *b)
+{
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+char **
+glob_expand(struct glob_cache *cache, struct arena *arena, const char *pattern, size_t *count)
+{
+    struct paths out = { NULL, 0, 0 };
+    if (*pattern == '/')
+        expand(cache, "/", pattern + 1, &out);
+    else
+        expand(cache, "", pattern, &out);
+
+    *count = out.n;
+    if (out.n == 0)
+    {
+        free(out.v);
+        return NULL;
+    }
+
+    qsort(out.v, out.n, sizeof *out.v, compare_paths);
+    char **result = arena_alloc(arena, (out.n + 1) * sizeof *result);
+    for (size_t i = 0; i < out.n; i++)
+    {
+        size_t len = strlen(out.v[i]) + 1;
+        result[i] = memcpy(arena_alloc(arena, len), out.v[i], len);
+        free(out.v[i]);
+    }
+    result[out.n] = NULL;
+    free(out.v);
+    return result;
+}
@@ -0,0 +1,41 @@
+#ifndef __GLOB_EXPAND_H
+#define __GLOB_EXPAND_H
+
+#include <stdbool.h>
+
+#include "arena.h"
+
+/*
+ * Pathname expansion: *, ?, [...] and **.
+ *
+ * Patterns are matched one path component at a time against directory
+ * listings, which are read with getdents64 and kept in a cache, so
+ * several patterns over the same directory, as in 'cp a*.log b*.log
+ * dest/', read it once.  The shell empties the cache whenever a
+ * command may have changed the file system.
+ *
+ * A component '**' matches any number of directories, including none,
+ * without following symbolic links or entering hidden directories; on
+ * its own at the end it matches everything below.  Large trees are
+ * walked by a few threads at once.
+ *
+ * Wildcards do not match a leading '.'.
+ */
+struct glob_cache;
+
+struct glob_cache *glob_cache_create(void);
+void glob_cache_destroy(struct glob_cache *cache);
+
+/* Forget every listing */
+void glob_cache_clear(struct glob_cache *cache);
+
+/* True if 'word' contains *, ? or a [...] bracket expression */
+bool glob_is_pattern(const char *word);
+
+/* Return the paths that match 'pattern', sorted and NULL terminated,
+ * allocated from 'arena', or NULL if there are none.  Set *count to
+ * their number. */
+char **glob_expand(struct glob_cache *cache, struct arena *arena,
+                   const char *pattern, size_t *count);
+
+#endif /* __GLOB_EXPAND_H */
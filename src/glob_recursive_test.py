@@ -0,0 +1,64 @@
+#!/usr/bin/python
+#
+# glob_recursive_test: tests **, bracket expressions, hidden files,
+# patterns that match nothing, quoted patterns and patterns in for loops
+#
+# Expands patterns in a temporary directory tree
+#
+
+import sys, imp, atexit, pexpect, proc_check, signal, time, threading
+from testutils import *
+import tempfile, shutil, os
+
+console = setup_tests()
+
+# ensure that shell prints expected prompt
+expect_prompt()
+
+tmpdir = tempfile.mkdtemp("-cush-glob-recursive")
+atexit.register(lambda: shutil.rmtree(tmpdir))
+for d in ['src/a/b', 'src/c', 'src/.git']:
+    os.makedirs(tmpdir + "/" + d)
+for f in ['top.c', 'src/m.c', 'src/a/n.c', 'src/a/b/o.c', 'src/c/p.h',
+          'src/.git/q.c', 'src/.r.c']:
+    open(tmpdir + "/" + f, "w")
+
+sendline("cd " + tmpdir)
+expect_prompt()
+
+# ** matches any number of directories, but not hidden ones
+sendline("echo **/*.c")
+expect_exact("src/a/b/o.c src/a/n.c src/m.c top.c", "**/*.c was not expanded")
+expect_prompt()
+
+# a final ** matches everything below its directory
+sendline("echo src/a/**")
+expect_exact("src/a/b src/a/b/o.c src/a/n.c", "a final ** was not expanded")
+expect_prompt()
+
+# bracket expressions, and a trailing / matching directories only
+sendline("echo src/[ac]/ src/[b-z]/*")
+expect_exact("src/a/ src/c/ src/c/p.h", "brackets or a trailing / did not work")
+expect_prompt()
+
+# a pattern that matches nothing is passed on unchanged
+sendline("echo nothing*here | rev")
+expect_exact("ereh*gnihton", "a pattern without matches was changed")
+expect_prompt()
+
+# files created earlier on the same line are seen
+sendline("touch src/new.c; echo src/*.c")
+expect_exact("src/m.c src/new.c", "a new file was missed")
+expect_prompt()
+
+# quoted words are not globbed
+sendline("echo \"src/*.c\" | rev")
+expect_exact("c.*/crs", "a quoted pattern was expanded")
+expect_prompt()
+
+# for loops expand their words
+sendline("for f in src/*/*.c; do echo item_$f; done")
+expect_exact("item_src/a/n.c", "for did not expand a pattern")
+expect_prompt()
+
+test_success()
@@ -0,0 +1,52 @@
+#!/usr/bin/python
+#
+# hash_test: tests the hash command
+#
+# Test the hash command
+#
+
+import sys, imp, atexit, pexpect, proc_check, signal, time, threading
+from testutils import *
+
+console = setup_tests()
+
+# ensure that shell prints expected prompt
+expect_prompt()
+
+# a fresh shell has not remembered anything
+sendline("hash -r")
+sendline("hash")
+expect_exact("hash: hash table empty", "expected an empty hash table")
+
+# running a command remembers where it was found
+sendline("basename remembered")
+expect_exact("remembered", "could not execute command 'basename remembered'")
+sendline("hash")
+expect("hits\tcommand")
+expect("1\t/.*/basename")
+
+# each use is counted
+sendline("basename again")
+expect_exact("again", "could not execute command 'basename again'")
+sendline("hash")
+expect("2\t/.*/basename")
+
+# hash -p installs a location under a different name
+sendline("hash -p /bin/echo myecho")
+sendline("myecho from hash -p")
+expect_exact("from hash -p", "hash -p did not install a command")
+
+# hash -r forgets everything
+sendline("hash -r")
+sendline("hash")
+expect_exact("hash: hash table empty", "hash -r did not clear the table")
+
+# unknown commands are reported
+sendline("hash nosuchcommandanywhere")
+expect_exact("hash: nosuchcommandanywhere: not found", "expected not found message")
+
+#exit
+sendline("exit")
+expect_exact("exit\r\n", "Shell output extraneous characters")
+
+test_success()
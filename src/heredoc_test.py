@@ -0,0 +1,67 @@
+#!/usr/bin/python
+#
+# heredoc_test: tests here-documents and here-strings
+#
+# Feeds here-documents and here-strings to builtins and external commands
+#
+
+import sys, imp, atexit, pexpect, proc_check, signal, time, threading
+from testutils import *
+
+console = setup_tests()
+
+# ensure that shell prints expected prompt
+expect_prompt()
+
+# the body follows on continuation lines, up to the delimiter
+sendline("rev <<END")
+expect_exact("> ", "expected a continuation prompt")
+sendline("abc")
+expect_exact("> ", "expected a continuation prompt")
+sendline("  xyz")
+expect_exact("> ", "expected a continuation prompt")
+sendline("END")
+expect_exact("cba\r\nzyx  ", "the here-document was not read")
+expect_prompt()
+
+# variables in the body are expanded
+sendline("w=dlrow")
+expect_prompt()
+sendline("rev <<E | tr a-z A-Z")
+expect_exact("> ", "expected a continuation prompt")
+sendline("$w")
+expect_exact("> ", "expected a continuation prompt")
+sendline("E")
+expect_exact("WORLD", "the here-document was not expanded")
+expect_prompt()
+
+# a quoted delimiter keeps the body as it is
+sendline("rev <<\"E\"")
+expect_exact("> ", "expected a continuation prompt")
+sendline("$w")
+expect_exact("> ", "expected a continuation prompt")
+sendline("E")
+expect_exact("w$", "a quoted here-document was expanded")
+expect_prompt()
+
+# a here-string is the word and a newline
+sendline("wc -c <<< abcdefg")
+expect_exact("8", "the here-string was not fed")
+expect_prompt()
+
+# the command reads a sealed memfd, not a pipe or a file
+sendline("ls -l /proc/self/fd/0 <<< x")
+expect_exact("memfd:cush-here", "stdin is not a memfd")
+expect_prompt()
+
+# so does a builtin that runs in the shell
+sendline("test -f /dev/stdin <<< x && rev <<< ralugeR")
+expect_exact("Regular", "the builtin's stdin is not the memfd")
+expect_prompt()
+
+# only one input per command
+sendline("cat <<< a < /dev/null")
+expect_exact("Ambiguous input redirect.", "two inputs were accepted")
+expect_prompt()
+
+test_success()
@@ -0,0 +1,142 @@
+/*
+ * Build-time generator for the builtin lookup table.
+ *
+ * Reads the names in builtins.def and searches for a perfect hash over
+ * them in the style of gperf: each character that occurs at a sampled
+ * position gets an associated value, and
+ *
+ *     hash = len + asso[first] + asso[second] + asso[last]   (mod size)
+ *
+ * must differ for every name.  The table size is the smallest power of
+ * two at least twice the number of builtins, so a lookup costs one
+ * strlen, three table loads, a mask and a single strcmp.
+ *
+ * The result is written to stdout as C: the asso values, the slot table
+ * (index into builtins.def order, or -1) and the hash function itself,
+ * so the function and the values it was searched with cannot drift.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+static const char *names[] = {
+#define BUILTIN(name, handler, flags) name,
+#include "builtins.def"
+#undef BUILTIN
+};
+
+#define NNAMES (sizeof(names) / sizeof(names[0]))
+#define MAX_TRIES 1000000
+
+static unsigned asso[256];
+static int slots[256];
+static unsigned table_size;
+
+static unsigned hash(const char *s)
+{
+    size_t len = strlen(s);
+    unsigned h = len + asso[(unsigned char)s[0]] + asso[(unsigned char)s[len - 1]];
+    if (len > 1)
+    {
+        h += asso[(unsigned char)s[1]];
+    }
+    return h & (table_size - 1);
+}
+
+/* Small fixed LCG, so every build produces the same table */
+static uint32_t lcg_state = 1;
+
+static unsigned lcg_next(void)
+{
+    lcg_state = lcg_state * 1103515245u + 12345u;
+    return lcg_state >> 16;
+}
+
+/* Fill slots[] from the current asso values; return 0 on any collision */
+static int try_assignment(void)
+{
+    for (unsigned i = 0; i < table_size; i++)
+    {
+        slots[i] = -1;
+    }
+    for (size_t i = 0; i < NNAMES; i++)
+    {
+        unsigned h = hash(names[i]);
+        if (slots[h] != -1)
+        {
+            if (strcmp(names[slots[h]], names[i]) == 0)
+            {
+                fprintf(stderr, "mkbuiltinhash: duplicate builtin '%s'\n", names[i]);
+                exit(EXIT_FAILURE);
+            }
+            return 0;
+        }
+        slots[h] = i;
+    }
+    return 1;
+}
+
+int main(void)
+{
+    table_size = 1;
+    while (table_size < 2 * NNAMES)
+    {
+        table_size <<= 1;
+    }
+    if (table_size > sizeof(slots) / sizeof(slots[0]))
+    {
+        fprintf(stderr, "mkbuiltinhash: too many builtins\n");
+        return EXIT_FAILURE;
+    }
+
+    int tries;
+    for (tries = 0; tries < MAX_TRIES; tries++)
+    {
+        for (size_t i = 0; i < NNAMES; i++)
+        {
+            size_t len = strlen(names[i]);
+            asso[(unsigned char)names[i][0]] = lcg_next() & (table_size - 1);
+            asso[(unsigned char)names[i][1 % len]] = lcg_next() & (table_size - 1);
+            asso[(unsigned char)names[i][len - 1]] = lcg_next() & (table_size - 1);
+        }
+        if (try_assignment())
+        {
+            break;
+        }
+    }
+    if (tries == MAX_TRIES)
+    {
+        fprintf(stderr, "mkbuiltinhash: no perfect hash found\n");
+        return EXIT_FAILURE;
+    }
+
+    printf("/* Generated by mkbuiltinhash from builtins.def; do not edit. */\n\n");
+    printf("#define BUILTIN_HASH_SIZE %u\n\n", table_size);
+
+    printf("static const unsigned char builtin_asso[256] = {");
+    for (int c = 0; c < 256; c++)
+    {
+        printf("%s%u,", c % 16 ? " " : "\n    ", asso[c]);
+    }
+    printf("\n};\n\n");
+
+    printf("/* Index into the builtins table for each hash value, or -1 */\n");
+    printf("static const signed char builtin_slots[BUILTIN_HASH_SIZE] = {");
+    for (unsigned i = 0; i < table_size; i++)
+    {
+        printf("%s%d,", i % 16 ? " " : "\n    ", slots[i]);
+    }
+    printf("\n};\n\n");
+
+    printf("static inline unsigned builtin_name_hash(const char *s, size_t len)\n"
+           "{\n"
+           "    unsigned h = len + builtin_asso[(unsigned char)s[0]] + builtin_asso[(unsigned char)s[len - 1]];\n"
+           "    if (len > 1)\n"
+           "    {\n"
+           "        h += builtin_asso[(unsigned char)s[1]];\n"
+           "    }\n"
+           "    return h & (BUILTIN_HASH_SIZE - 1);\n"
+           "}\n");
+    return EXIT_SUCCESS;
+}
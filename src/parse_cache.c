@@ -0,0 +1,121 @@
+/*
+ * LRU cache of parsed command lines.
+ *
+ * A small chained hash table keyed by the text of the line, with the
+ * entries also kept on a list in order of use, most recent first.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "parse_cache.h"
+
+struct cache_entry
+{
+    struct cache_entry *next;       /* Next entry in the same bucket */
+    struct list_elem lru;           /* Position in lru_list */
+    struct ast_command_line *cline; /* The cache's reference to the AST */
+    uint32_t hash;
+    char line[];                    /* Text the AST was parsed from */
+};
+
+/* Twice the capacity, so chains stay short */
+#define NBUCKETS (2 * PARSE_CACHE_SIZE)
+
+static struct cache_entry *buckets[NBUCKETS];
+static struct list lru_list;
+static bool lru_list_initialized;
+static size_t nentries;
+static unsigned long hits, misses, evictions;
+
+/* FNV-1a */
+static uint32_t
+hash_line(const char *line)
+{
+    uint32_t h = 2166136261u;
+    while (*line)
+    {
+        h ^= (unsigned char)*line++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static void
+free_entry(struct cache_entry *e)
+{
+    ast_command_line_free(e->cline);
+    free(e);
+}
+
+/* Unlink the least recently used entry and free it */
+static void
+evict(void)
+{
+    struct cache_entry *victim = list_entry(list_pop_back(&lru_list), struct cache_entry, lru);
+    struct cache_entry **pe = &buckets[victim->hash % NBUCKETS];
+    while (*pe != victim)
+        pe = &(*pe)->next;
+    *pe = victim->next;
+    free_entry(victim);
+    nentries--;
+    evictions++;
+}
+
+struct ast_command_line *
+parse_cache_parse(const char *line)
+{
+    if (!lru_list_initialized)
+    {
+        list_init(&lru_list);
+        lru_list_initialized = true;
+    }
+
+    uint32_t h = hash_line(line);
+    struct cache_entry **b = &buckets[h % NBUCKETS];
+    for (struct cache_entry *e = *b; e; e = e->next)
+    {
+        if (e->hash == h && strcmp(e->line, line) == 0)
+        {
+            hits++;
+            list_remove(&e->lru);
+            list_push_front(&lru_list, &e->lru);
+            return ast_command_line_get(e->cline);
+        }
+    }
+
+    misses++;
+    struct ast_command_line *cline = ast_parse_command_line(line);
+    if (cline == NULL)
+        return NULL;
+
+    if (nentries == PARSE_CACHE_SIZE)
+        evict();
+
+    size_t len = strlen(line);
+    struct cache_entry *e = malloc(sizeof *e + len + 1);
+    memcpy(e->line, line, len + 1);
+    e->hash = h;
+    e->cline = ast_command_line_get(cline);
+    e->next = *b;
+    *b = e;
+    list_push_front(&lru_list, &e->lru);
+    nentries++;
+    return cline;
+}
+
+void
+parse_cache_clear(void)
+{
+    while (nentries > 0)
+        evict();
+    hits = misses = evictions = 0;
+}
+
+void
+parse_cache_print(void)
+{
+    printf("parse cache: %lu hits, %lu misses, %lu evictions, %zu/%d lines\n",
+           hits, misses, evictions, nentries, PARSE_CACHE_SIZE);
+}
@@ -0,0 +1,30 @@
+#ifndef __PARSE_CACHE_H
+#define __PARSE_CACHE_H
+
+#include "shell-ast.h"
+
+/*
+ * Cache of parsed command lines.
+ *
+ * Maps the exact text of a line to the AST it parsed into, so a line
+ * that is run again and again ('!!', '!make', loops in scripts) is
+ * lexed and parsed only once.  Parsed command lines are never modified,
+ * so every execution shares the cached AST and just holds a reference;
+ * a job keeps its pipeline alive even after the line is evicted.
+ * The least recently used line is evicted once the cache is full.
+ */
+#define PARSE_CACHE_SIZE 64
+
+/* Parse 'line', or return the cached result of parsing it before.
+ * The caller owns one reference and drops it with ast_command_line_free.
+ * Lines that fail to parse are not cached, so the parser reports the
+ * error again each time; NULL is returned for them. */
+struct ast_command_line *parse_cache_parse(const char *line);
+
+/* Drop all cached lines and reset the counters. */
+void parse_cache_clear(void);
+
+/* Print the hit and miss counters, as the 'parsecache' builtin does. */
+void parse_cache_print(void);
+
+#endif /* __PARSE_CACHE_H */
@@ -0,0 +1,54 @@
+#!/usr/bin/python
+#
+# parse_cache_test: tests the parse cache and the parsecache command
+#
+# Test that repeated command lines are parsed once and that jobs
+# outlive the cached lines they came from
+#
+
+import sys, imp, atexit, pexpect, proc_check, signal, time, threading
+from testutils import *
+
+console = setup_tests()
+
+# ensure that shell prints expected prompt
+expect_prompt()
+
+# start from an empty cache
+sendline("parsecache -r")
+expect_prompt()
+sendline("parsecache")
+expect_exact("parse cache: 0 hits, 1 misses, 0 evictions, 1/64 lines",
+             "expected an empty parse cache")
+
+# a line is parsed the first time and found in the cache after that
+sendline("echo cached line")
+expect_exact("cached line", "could not execute command 'echo cached line'")
+sendline("echo cached line")
+expect_exact("cached line", "a cached line did not run")
+sendline("parsecache")
+expect_exact("parse cache: 2 hits, 2 misses, 0 evictions, 2/64 lines",
+             "expected one hit for the repeated line")
+
+# a job keeps its pipeline after the cache lets go of it
+sendline("sleep 30 &")
+expect(r"\[(\d+)\] (\d+)", "expected a background job")
+jobid = int(console.match.group(1))
+sendline("parsecache -r")
+expect_prompt()
+sendline("jobs")
+expect_exact("(sleep 30)", "the job lost its command line")
+run_builtin('kill', jobid)
+expect_prompt()
+
+# lines that fail to parse are reported every time
+sendline("echo >")
+expect_exact("Missing name for redirect.", "expected a parse error")
+sendline("echo >")
+expect_exact("Missing name for redirect.", "expected the parse error again")
+
+#exit
+sendline("exit")
+expect_exact("exit\r\n", "Shell output extraneous characters")
+
+test_success()
@@ -0,0 +1,181 @@
+/*
+ * Microbenchmark for the command line parser.
+ *
+ * Reads a corpus of command lines (one per line), then parses and frees
+ * every line of it repeatedly and reports how many lines per second the
+ * parser handles and how many heap allocations each line costs, once
+ * calling the parser directly and once through the parse cache.
+ * Finally the corpus is parsed on several threads at once, each with its
+ * own parser context.  Nothing is executed.
+ *
+ * Usage: ./parsebench [corpus file] [number of passes] [number of threads]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "shell-ast.h"
+#include "parse_cache.h"
+
+#define MAX_LINES 4096
+
+/* Count calls into the allocator by interposing on glibc's malloc */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+static long allocations;
+
+#define COUNT_ALLOCATION() __atomic_add_fetch(&allocations, 1, __ATOMIC_RELAXED)
+
+void *malloc(size_t size)
+{
+    COUNT_ALLOCATION();
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+    COUNT_ALLOCATION();
+    return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    COUNT_ALLOCATION();
+    return __libc_realloc(ptr, size);
+}
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Parse every line 'passes' times with parse() and report the rate */
+static void run(const char *name, struct ast_command_line *(*parse)(const char *),
+                char **lines, int nlines, int passes)
+{
+    long failed = 0;
+    allocations = 0;
+    double start = now();
+    for (int p = 0; p < passes; p++)
+    {
+        for (int i = 0; i < nlines; i++)
+        {
+            struct ast_command_line *cline = parse(lines[i]);
+            if (cline == NULL)
+            {
+                failed++;
+                continue;
+            }
+            ast_command_line_free(cline);
+        }
+    }
+    double spent = now() - start;
+    long allocated = allocations;
+
+    printf("%s: %d lines x %d passes: %.0f lines/sec, %.1f allocations/line", name, nlines, passes,
+           (double)nlines * passes / spent, (double)allocated / ((double)nlines * passes));
+    if (failed)
+    {
+        printf(" (%ld failed to parse)", failed);
+    }
+    printf("\n");
+}
+
+struct worker
+{
+    pthread_t thread;
+    char **lines;
+    int nlines, passes;
+    long failed;
+};
+
+/* Parse the corpus with a context of this thread's own */
+static void *parse_worker(void *arg)
+{
+    struct worker *w = arg;
+    struct ast_parser *parser = ast_parser_create();
+    for (int p = 0; p < w->passes; p++)
+    {
+        for (int i = 0; i < w->nlines; i++)
+        {
+            struct ast_command_line *cline = ast_parser_parse(parser, w->lines[i], false);
+            if (cline == NULL)
+            {
+                w->failed++;
+                continue;
+            }
+            ast_command_line_free(cline);
+        }
+    }
+    ast_parser_destroy(parser);
+    return NULL;
+}
+
+/* Parse every line 'passes' times on each of 'nthreads' threads */
+static void run_threads(int nthreads, char **lines, int nlines, int passes)
+{
+    struct worker workers[nthreads];
+    long failed = 0;
+    allocations = 0;
+    double start = now();
+    for (int t = 0; t < nthreads; t++)
+    {
+        workers[t] = (struct worker) { .lines = lines, .nlines = nlines, .passes = passes };
+        pthread_create(&workers[t].thread, NULL, parse_worker, &workers[t]);
+    }
+    for (int t = 0; t < nthreads; t++)
+    {
+        pthread_join(workers[t].thread, NULL);
+        failed += workers[t].failed;
+    }
+    double spent = now() - start;
+    double total = (double)nlines * passes * nthreads;
+
+    printf("parser, %d threads: %d lines x %d passes each: %.0f lines/sec, %.1f allocations/line",
+           nthreads, nlines, passes, total / spent, (double)allocations / total);
+    if (failed)
+    {
+        printf(" (%ld failed to parse)", failed);
+    }
+    printf("\n");
+}
+
+int main(int argc, char *argv[])
+{
+    const char *corpus = argc > 1 ? argv[1] : "parsebench.txt";
+    int passes = argc > 2 ? atoi(argv[2]) : 20000;
+    int nthreads = argc > 3 ? atoi(argv[3]) : 4;
+
+    FILE *f = fopen(corpus, "r");
+    if (f == NULL)
+    {
+        perror(corpus);
+        return EXIT_FAILURE;
+    }
+
+    static char *lines[MAX_LINES];
+    int nlines = 0;
+    char *line = NULL;
+    size_t cap = 0;
+    while (nlines < MAX_LINES && getline(&line, &cap, f) != -1)
+    {
+        line[strcspn(line, "\n")] = '\0';   /* as readline would */
+        lines[nlines++] = strdup(line);
+    }
+    free(line);
+    fclose(f);
+
+    run("parser", ast_parse_command_line, lines, nlines, passes);
+    run("parse cache", parse_cache_parse, lines, nlines, passes);
+    if (nthreads > 0)
+    {
+        run_threads(nthreads, lines, nlines, passes);
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,210 @@
+/*
+ * Reading command lines from a script file or a -c argument.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "script.h"
+#include "utils.h"
+
+#define STREAM_BUFSIZE (64 * 1024)
+
+struct script
+{
+    char *buf;      /* Text not consumed yet starts at buf + pos */
+    size_t pos;
+    size_t base;    /* Offset in the file of buf[0] */
+    size_t len;     /* Bytes of text in buf */
+    size_t cap;     /* Size of buf when streaming */
+    bool mapped;    /* buf is a read-only mapping of the whole file */
+    int fd;         /* File being streamed, or -1 */
+    char *line;     /* The last line of a mapped file, with its NUL */
+    size_t line_cap;
+};
+
+static struct script *
+script_create(void)
+{
+    struct script *s = calloc(1, sizeof *s);
+    s->fd = -1;
+    return s;
+}
+
+struct script *
+script_open(const char *path)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return NULL;
+
+    struct script *s = script_create();
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+    {
+        /* Read-only: terminating lines in place would copy every page
+         * that holds a newline, so each line is copied into a buffer
+         * that is reused instead. */
+        void *p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED)
+        {
+            madvise(p, st.st_size, MADV_SEQUENTIAL);
+            s->buf = p;
+            s->len = st.st_size;
+            s->mapped = true;
+            close(fd);
+            return s;
+        }
+    }
+
+    s->fd = fd;
+    s->cap = STREAM_BUFSIZE;
+    s->buf = malloc(s->cap);
+    return s;
+}
+
+struct script *
+script_from_string(const char *text)
+{
+    struct script *s = script_create();
+    s->len = strlen(text);
+    s->cap = s->len + 1;
+    s->buf = malloc(s->cap);
+    memcpy(s->buf, text, s->cap);
+    return s;
+}
+
+/* Move the unconsumed text to the front and read more after it.
+ * Returns false at end of file. */
+static bool
+fill(struct script *s)
+{
+    memmove(s->buf, s->buf + s->pos, s->len - s->pos);
+    s->len -= s->pos;
+    s->base += s->pos;
+    s->pos = 0;
+
+    /* keep one byte spare to terminate a final line */
+    if (s->len + 1 >= s->cap)
+    {
+        s->cap *= 2;
+        s->buf = realloc(s->buf, s->cap);
+    }
+
+    ssize_t n;
+    do
+        n = read(s->fd, s->buf + s->len, s->cap - 1 - s->len);
+    while (n == -1 && errno == EINTR);
+
+    if (n == -1)
+        utils_error("read error: ");
+    if (n <= 0)
+        return false;
+
+    s->len += n;
+    return true;
+}
+
+/* Copy the 'n' bytes at 'start' into the line buffer of a mapped file */
+static char *
+copy_line(struct script *s, const char *start, size_t n)
+{
+    if (n + 1 > s->line_cap)
+    {
+        s->line_cap = 2 * (n + 1);
+        free(s->line);
+        s->line = malloc(s->line_cap);
+    }
+    memcpy(s->line, start, n);
+    s->line[n] = '\0';
+    return s->line;
+}
+
+static char *
+next_line(struct script *s)
+{
+    for (;;)
+    {
+        char *start = s->buf + s->pos;
+        char *nl = memchr(start, '\n', s->len - s->pos);
+        if (nl)
+        {
+            s->pos = nl + 1 - s->buf;
+            if (s->mapped)
+                return copy_line(s, start, nl - start);
+            *nl = '\0';
+            return start;
+        }
+        if (s->fd == -1 || !fill(s))
+            break;
+    }
+
+    if (s->pos == s->len)
+        return NULL;
+
+    /* a final line without a newline */
+    size_t n = s->len - s->pos;
+    char *line;
+    if (s->mapped)
+    {
+        line = copy_line(s, s->buf + s->pos, n);
+    }
+    else
+    {
+        line = s->buf + s->pos;
+        line[n] = '\0';
+    }
+    s->pos = s->len;
+    return line;
+}
+
+char *
+script_next_line(struct script *s, bool continued)
+{
+    char *line;
+    while ((line = next_line(s)) != NULL && !continued && line[strspn(line, " \t")] == '#')
+        continue;
+    return line;
+}
+
+size_t
+script_offset(struct script *s)
+{
+    return s->base + s->pos;
+}
+
+void
+script_seek(struct script *s, size_t offset)
+{
+    if (s->fd == -1)
+    {
+        s->pos = offset < s->len ? offset : s->len;
+        return;
+    }
+    if (lseek(s->fd, offset, SEEK_SET) == -1)
+    {
+        utils_error("seek error: ");
+        return;
+    }
+    s->base = offset;
+    s->pos = s->len = 0;
+}
+
+void
+script_close(struct script *s)
+{
+    if (s->mapped)
+        munmap(s->buf, s->len);
+    else
+        free(s->buf);
+    if (s->fd != -1)
+        close(s->fd);
+    free(s->line);
+    free(s);
+}
@@ -0,0 +1,39 @@
+#ifndef __SCRIPT_H
+#define __SCRIPT_H
+
+#include <stdbool.h>
+
+/*
+ * Command lines for a non-interactive shell ('cush file', 'cush -c cmd').
+ *
+ * A regular file is mapped read-only and each line is copied out into a
+ * buffer that is reused, so reading it costs no system calls per line
+ * and no copies of the file's pages.  Anything else (a pipe,
+ * /dev/stdin) is streamed through a large buffer.
+ */
+struct script;
+
+/* Open a script file.  Returns NULL with errno set on failure. */
+struct script *script_open(const char *path);
+
+/* Use the text of a -c argument as the script. */
+struct script *script_from_string(const char *text);
+
+/* Return the next line without its newline, or NULL at the end.
+ * Lines whose first word starts with # are comments and are skipped,
+ * which takes care of a #! line, unless 'continued' says the line goes
+ * on an unfinished command, whose here-document it may be part of; the
+ * scanner drops the comments of such a line otherwise.
+ * The line is valid until the next call. */
+char *script_next_line(struct script *script, bool continued);
+
+/* The offset in the file of the line the next call returns. */
+size_t script_offset(struct script *script);
+
+/* Go on reading at 'offset', which script_offset returned while reading
+ * the same file. */
+void script_seek(struct script *script, size_t offset);
+
+void script_close(struct script *script);
+
+#endif /* __SCRIPT_H */
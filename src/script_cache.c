@@ -0,0 +1,782 @@
+/*
+ * Compiling scripts into cached AST images, and running them from there.
+ *
+ * An image is a header, the script's path, the code and a string table.
+ * The code is a sequence of 32-bit words, for each command line:
+ *
+ *     npipes
+ *       per pipeline: flags, input, here, output, ncmds
+ *         per command: flags, nassigns, assignments, argc, argv[0] ... argv[argc - 1],
+ *                      nquoted, quoted
+ *     nops, nloops
+ *       per operation: opcode, then for
+ *         AST_OP_RUN: the index of the pipeline
+ *         AST_OP_JUMP*: target
+ *         AST_OP_SET_STATUS, AST_OP_FOR_START: arg
+ *         AST_OP_FOR_NEXT: arg, target, name, nwords, words, nquoted, quoted
+ *         AST_OP_ASSIGN: nwords, words
+ *
+ * where input, here (the text of a here-document or here-string), output,
+ * name, the assignments and the words are offsets into the string
+ * table (NO_STRING for a missing redirection), and quoted lists the
+ * indices of the words that were quoted.  Equal strings are stored
+ * once.  Since nothing in the image is a pointer it can be mapped at any
+ * address and used in place: the rebuilt ASTs point at its strings.
+ */
+#define _GNU_SOURCE 1
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "script_cache.h"
+#include "script.h"
+
+#define IMAGE_MAGIC "cushscr"
+#define IMAGE_VERSION 7
+#define NO_STRING UINT32_MAX
+#define NO_REST UINT64_MAX
+
+#define PIPE_BG         0x01
+#define PIPE_APPEND     0x02
+#define PIPE_HERE_LITERAL 0x04
+#define CMD_DUP_STDERR  0x01
+
+struct image_header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t nlines;
+    uint64_t size;          /* Size of the script */
+    int64_t mtime_sec;      /* and its modification time */
+    int64_t mtime_nsec;
+    uint64_t rest;          /* Offset of a command that does not parse, or NO_REST */
+    uint32_t path_len;      /* Its path follows the header, with a NUL */
+    uint32_t code;          /* Offset of the code */
+    uint32_t code_len;      /* in words */
+    uint32_t strings;       /* Offset of the string table */
+    uint32_t strings_len;
+    uint32_t reserved;
+};
+
+struct compiled_script
+{
+    const char *image;
+    size_t size;
+    bool mapped;            /* image is a mapping, else malloc'd */
+    const uint32_t *code;
+    const char *strings;
+    uint32_t lines_left;
+    uint64_t rest;
+};
+
+/* Initial arena size for a line of 'n' pipelines and operations;
+ * typical lines fit */
+#define LINE_ARENA_SIZE(n) (64 + 256 * (n))
+
+/* ---- where cache files live ---- */
+
+/* mkdir -p, for the cache directory */
+static bool
+make_dirs(char *path)
+{
+    for (char *p = path + 1; ; p++)
+    {
+        if (*p != '/' && *p != '\0')
+            continue;
+        char c = *p;
+        *p = '\0';
+        int rc = mkdir(path, 0700);
+        *p = c;
+        if (rc == -1 && errno != EEXIST)
+            return false;
+        if (c == '\0')
+            return true;
+    }
+}
+
+/* An image runs whatever commands it holds, so only files and
+ * directories that nobody else could have written to are used */
+static bool
+trusted(const struct stat *st)
+{
+    return st->st_uid == geteuid() && (st->st_mode & (S_IWGRP | S_IWOTH)) == 0;
+}
+
+/* FNV-1a, 64 bit */
+static uint64_t
+hash_path(const char *path)
+{
+    uint64_t h = 14695981039346656037ull;
+    while (*path)
+    {
+        h ^= (unsigned char)*path++;
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+/* Return the malloc'd name of the cache file for the script whose
+ * canonical path is 'path', or NULL if caching is off or the cache
+ * directory is not the user's own. */
+static char *
+cache_file_name(const char *path)
+{
+    char *dir;
+    const char *env = getenv("CUSH_CACHE_DIR");
+    if (env != NULL)
+    {
+        if (*env == '\0')
+            return NULL;
+        dir = strdup(env);
+    }
+    else if ((env = getenv("XDG_CACHE_HOME")) != NULL && *env == '/')
+    {
+        if (asprintf(&dir, "%s/cush", env) == -1)
+            return NULL;
+    }
+    else if ((env = getenv("HOME")) != NULL && *env == '/')
+    {
+        if (asprintf(&dir, "%s/.cache/cush", env) == -1)
+            return NULL;
+    }
+    else
+    {
+        return NULL;
+    }
+
+    char *name = NULL;
+    struct stat st;
+    if (make_dirs(dir)
+        && stat(dir, &st) == 0 && S_ISDIR(st.st_mode) && trusted(&st)
+        && asprintf(&name, "%s/%016llx.img", dir,
+                    (unsigned long long)hash_path(path)) == -1)
+        name = NULL;
+    free(dir);
+    return name;
+}
+
+/* ---- compiling ---- */
+
+struct image_writer
+{
+    uint32_t *code;
+    size_t code_len, code_cap;
+    char *strings;
+    size_t strings_len, strings_cap;
+    uint32_t *interned;     /* Open addressing table of string offsets + 1 */
+    size_t interned_cap, ninterned;
+    uint32_t nlines;
+    uint64_t rest;          /* Where compiling stopped, or NO_REST */
+};
+
+static void
+emit(struct image_writer *w, uint32_t word)
+{
+    if (w->code_len == w->code_cap)
+    {
+        w->code_cap = w->code_cap ? 2 * w->code_cap : 1024;
+        w->code = realloc(w->code, w->code_cap * sizeof *w->code);
+    }
+    w->code[w->code_len++] = word;
+}
+
+static uint32_t *
+intern_slot(struct image_writer *w, const char *s, size_t len)
+{
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++)
+        h = (h ^ (unsigned char)s[i]) * 16777619u;
+
+    size_t mask = w->interned_cap - 1;
+    uint32_t *slot;
+    for (size_t i = h & mask; ; i = (i + 1) & mask)
+    {
+        slot = &w->interned[i];
+        if (*slot == 0 || strcmp(w->strings + *slot - 1, s) == 0)
+            return slot;
+    }
+}
+
+/* Return the offset of 's' in the string table, adding it if needed */
+static uint32_t
+intern(struct image_writer *w, const char *s)
+{
+    if (s == NULL)
+        return NO_STRING;
+
+    if (2 * (w->ninterned + 1) > w->interned_cap)
+    {
+        uint32_t *old = w->interned;
+        size_t old_cap = w->interned_cap;
+        w->interned_cap = old_cap ? 2 * old_cap : 256;
+        w->interned = calloc(w->interned_cap, sizeof *w->interned);
+        for (size_t i = 0; i < old_cap; i++)
+        {
+            if (old[i] != 0)
+            {
+                const char *t = w->strings + old[i] - 1;
+                *intern_slot(w, t, strlen(t)) = old[i];
+            }
+        }
+        free(old);
+    }
+
+    size_t len = strlen(s);
+    uint32_t *slot = intern_slot(w, s, len);
+    if (*slot != 0)
+        return *slot - 1;
+
+    while (w->strings_len + len + 1 > w->strings_cap)
+    {
+        w->strings_cap = w->strings_cap ? 2 * w->strings_cap : 4096;
+        w->strings = realloc(w->strings, w->strings_cap);
+    }
+    uint32_t offset = w->strings_len;
+    memcpy(w->strings + offset, s, len + 1);
+    w->strings_len += len + 1;
+    *slot = offset + 1;
+    w->ninterned++;
+    return offset;
+}
+
+/* A count and that many strings; NULL counts as no strings */
+static void
+emit_words(struct image_writer *w, char **words)
+{
+    size_t count_at = w->code_len;
+    emit(w, 0);
+    for (; words && *words; words++)
+        emit(w, intern(w, *words));
+    w->code[count_at] = w->code_len - count_at - 1;
+}
+
+/* The count and indices of the quoted ones among n words */
+static void
+emit_quoted(struct image_writer *w, const bool *quoted, char **words)
+{
+    size_t count_at = w->code_len;
+    emit(w, 0);
+    for (uint32_t i = 0; quoted && words[i]; i++)
+        if (quoted[i])
+            emit(w, i);
+    w->code[count_at] = w->code_len - count_at - 1;
+}
+
+static void
+compile_line(struct image_writer *w, struct ast_command_line *cline)
+{
+    size_t npipes_at = w->code_len;
+    uint32_t npipes = 0;
+    emit(w, 0);
+
+    for (struct list_elem *e = list_begin(&cline->pipes); e != list_end(&cline->pipes); e = list_next(e))
+    {
+        struct ast_pipeline *pipe = list_entry(e, struct ast_pipeline, elem);
+        emit(w, (pipe->bg_job ? PIPE_BG : 0) | (pipe->append_to_output ? PIPE_APPEND : 0)
+                | (pipe->here_literal ? PIPE_HERE_LITERAL : 0));
+        emit(w, intern(w, pipe->iored_input));
+        emit(w, intern(w, pipe->here ? ast_pipeline_here_text(pipe, pipe->arena) : NULL));
+        emit(w, intern(w, pipe->iored_output));
+        emit(w, pipe->ncmds);
+        for (size_t i = 0; i < pipe->ncmds; i++)
+        {
+            struct ast_command *cmd = &pipe->cmdv[i];
+            emit(w, cmd->dup_stderr_to_stdout ? CMD_DUP_STDERR : 0);
+            emit_words(w, cmd->assignments);
+            emit_words(w, cmd->argv);
+            emit_quoted(w, cmd->quoted, cmd->argv);
+        }
+        npipes++;
+    }
+    w->code[npipes_at] = npipes;
+
+    /* the pipelines are listed in the order of the ops that run them */
+    uint32_t nruns = 0;
+    emit(w, cline->ncode);
+    emit(w, cline->nloops);
+    for (size_t i = 0; i < cline->ncode; i++)
+    {
+        struct ast_op *op = &cline->code[i];
+        emit(w, op->opcode);
+        switch (op->opcode)
+        {
+        case AST_OP_RUN:
+            emit(w, nruns++);
+            break;
+        case AST_OP_JUMP:
+        case AST_OP_JUMP_IF_OK:
+        case AST_OP_JUMP_IF_FAILED:
+            emit(w, op->target);
+            break;
+        case AST_OP_SET_STATUS:
+        case AST_OP_FOR_START:
+            emit(w, op->arg);
+            break;
+        case AST_OP_FOR_NEXT:
+            emit(w, op->arg);
+            emit(w, op->target);
+            emit(w, intern(w, op->name));
+            emit_words(w, op->words);
+            emit_quoted(w, op->quoted, op->words);
+            break;
+        case AST_OP_ASSIGN:
+            emit_words(w, op->words);
+            break;
+        }
+    }
+    w->nlines++;
+}
+
+/* Parse the lines of the script, up to a command that does not parse.
+ * Returns false if the script cannot be read. */
+static bool
+compile(struct image_writer *w, const char *path)
+{
+    struct script *script = script_open(path);
+    if (script == NULL)
+        return false;
+
+    /* the shell runs the script line by line from where such a command
+     * starts, so the lines before it are parsed only once */
+    w->rest = NO_REST;
+    size_t start = 0;
+    bool continued = false;
+    char *line;
+    for (;;)
+    {
+        if (!continued)
+            start = script_offset(script);
+        if ((line = script_next_line(script, continued)) == NULL)
+            break;
+        /* a command may go on over several lines, as the shell reads them;
+         * the parser keeps the lines before and only scans the new one */
+        struct ast_command_line *cline = continued ? ast_parse_continued_line(line)
+                                                   : ast_parse_command_line_quietly(line);
+        continued = cline == NULL && ast_parse_incomplete();
+        if (continued)
+            continue;
+        if (cline == NULL)
+        {
+            w->rest = start;
+            break;
+        }
+        if (cline->ncode > 0)
+            compile_line(w, cline);
+        ast_command_line_free(cline);
+    }
+    if (continued)
+        w->rest = start;
+    script_close(script);
+    return true;
+}
+
+/* Lay the image out in one buffer */
+static char *
+link_image(struct image_writer *w, const char *path, const struct stat *st, size_t *size)
+{
+    struct image_header h;
+    memset(&h, 0, sizeof h);
+    memcpy(h.magic, IMAGE_MAGIC, sizeof h.magic);
+    h.version = IMAGE_VERSION;
+    h.nlines = w->nlines;
+    h.size = st->st_size;
+    h.mtime_sec = st->st_mtim.tv_sec;
+    h.mtime_nsec = st->st_mtim.tv_nsec;
+    h.rest = w->rest;
+    h.path_len = strlen(path);
+    h.code = (sizeof h + h.path_len + 1 + 3) & ~3u;
+    h.code_len = w->code_len;
+    h.strings = h.code + w->code_len * sizeof *w->code;
+    h.strings_len = w->strings_len;
+
+    *size = h.strings + h.strings_len;
+    char *image = calloc(1, *size);
+    memcpy(image, &h, sizeof h);
+    memcpy(image + sizeof h, path, h.path_len + 1);
+    /* nothing was emitted if the first command does not parse */
+    if (w->code_len > 0)
+        memcpy(image + h.code, w->code, w->code_len * sizeof *w->code);
+    if (w->strings_len > 0)
+        memcpy(image + h.strings, w->strings, w->strings_len);
+    return image;
+}
+
+/* Write the image under a temporary name and rename it into place, so
+ * another shell never maps a partly written file. */
+static void
+save_image(const char *name, const char *image, size_t size)
+{
+    char *tmp;
+    if (asprintf(&tmp, "%s.XXXXXX", name) == -1)
+        return;
+
+    int fd = mkstemp(tmp);
+    if (fd == -1)
+    {
+        free(tmp);
+        return;
+    }
+
+    size_t done = 0;
+    while (done < size)
+    {
+        ssize_t n = write(fd, image + done, size - done);
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        done += n;
+    }
+    if (close(fd) == 0 && done == size && rename(tmp, name) == 0)
+    {
+        free(tmp);
+        return;
+    }
+    unlink(tmp);
+    free(tmp);
+}
+
+/* ---- loading ---- */
+
+/* Check that every count and offset in the code stays inside the image,
+ * so a damaged cache file cannot make the shell read out of bounds. */
+static bool
+validate(const struct image_header *h, const uint32_t *code, const char *strings)
+{
+    if (h->strings_len > 0 && strings[h->strings_len - 1] != '\0')
+        return false;
+
+#define FETCH(v) do { if (pc == h->code_len) return false; (v) = code[pc++]; } while (0)
+#define CHECK_STRING(v, nullable) \
+    do { if ((v) >= h->strings_len && !((nullable) && (v) == NO_STRING)) return false; } while (0)
+#define CHECK_WORDS(n) \
+    do { FETCH(n); for (uint32_t a = 0; a < (n); a++) { FETCH(arg); CHECK_STRING(arg, false); } } while (0)
+#define CHECK_QUOTED(n) \
+    do { FETCH(nquoted); for (uint32_t a = 0; a < nquoted; a++) { FETCH(arg); if (arg >= (n)) return false; } } while (0)
+
+    uint32_t pc = 0;
+    for (uint32_t line = 0; line < h->nlines; line++)
+    {
+        uint32_t npipes, flags, in, here, out, ncmds, nassigns, argc, nquoted, arg, nops, nloops;
+        FETCH(npipes);
+        for (uint32_t p = 0; p < npipes; p++)
+        {
+            FETCH(flags);
+            FETCH(in);
+            FETCH(here);
+            FETCH(out);
+            FETCH(ncmds);
+            CHECK_STRING(in, true);
+            CHECK_STRING(here, true);
+            CHECK_STRING(out, true);
+            if ((flags & ~(PIPE_BG | PIPE_APPEND | PIPE_HERE_LITERAL)) != 0 || ncmds == 0)
+                return false;
+            for (uint32_t c = 0; c < ncmds; c++)
+            {
+                FETCH(flags);
+                if ((flags & ~CMD_DUP_STDERR) != 0)
+                    return false;
+                CHECK_WORDS(nassigns);
+                CHECK_WORDS(argc);
+                if (argc == 0)
+                    return false;
+                CHECK_QUOTED(argc);
+            }
+        }
+
+        FETCH(nops);
+        FETCH(nloops);
+        if (nloops > nops)
+            return false;
+        for (uint32_t i = 0; i < nops; i++)
+        {
+            uint32_t opcode, target, name, nwords;
+            FETCH(opcode);
+            switch (opcode)
+            {
+            case AST_OP_RUN:
+                FETCH(arg);
+                if (arg >= npipes)
+                    return false;
+                break;
+            case AST_OP_JUMP:
+            case AST_OP_JUMP_IF_OK:
+            case AST_OP_JUMP_IF_FAILED:
+                FETCH(target);
+                if (target > nops)
+                    return false;
+                break;
+            case AST_OP_SET_STATUS:
+                FETCH(arg);
+                break;
+            case AST_OP_FOR_START:
+                FETCH(arg);
+                if (arg >= nloops)
+                    return false;
+                break;
+            case AST_OP_FOR_NEXT:
+                FETCH(arg);
+                FETCH(target);
+                FETCH(name);
+                if (arg >= nloops || target > nops)
+                    return false;
+                CHECK_STRING(name, false);
+                CHECK_WORDS(nwords);
+                CHECK_QUOTED(nwords);
+                break;
+            case AST_OP_ASSIGN:
+                CHECK_WORDS(nwords);
+                if (nwords == 0)
+                    return false;
+                break;
+            default:
+                return false;
+            }
+        }
+    }
+    return pc == h->code_len;
+
+#undef FETCH
+#undef CHECK_STRING
+#undef CHECK_QUOTED
+#undef CHECK_WORDS
+}
+
+/* Point 'script' at the parts of a complete image and check it */
+static bool
+attach(struct compiled_script *script, const char *path, const struct stat *st)
+{
+    const struct image_header *h = (const void *)script->image;
+    if (script->size < sizeof *h
+        || memcmp(h->magic, IMAGE_MAGIC, sizeof h->magic) != 0
+        || h->version != IMAGE_VERSION
+        || h->size != (uint64_t)st->st_size
+        || h->mtime_sec != st->st_mtim.tv_sec
+        || h->mtime_nsec != st->st_mtim.tv_nsec
+        || (h->rest != NO_REST && h->rest > h->size)
+        || h->path_len != strlen(path)
+        || sizeof *h + h->path_len >= script->size
+        || memcmp(script->image + sizeof *h, path, h->path_len + 1) != 0
+        || h->code % sizeof(uint32_t) != 0
+        || h->code < sizeof *h + h->path_len + 1
+        || h->code_len > (script->size - h->code) / sizeof(uint32_t)
+        || h->strings < h->code + (uint64_t)h->code_len * sizeof(uint32_t)
+        || h->strings > script->size
+        || h->strings_len != script->size - h->strings)
+        return false;
+
+    script->code = (const uint32_t *)(script->image + h->code);
+    script->strings = script->image + h->strings;
+    script->lines_left = h->nlines;
+    script->rest = h->rest;
+    return validate(h, script->code, script->strings);
+}
+
+/* Map the cache file, if it holds an image of this version of the script */
+static struct compiled_script *
+load_image(const char *name, const char *path, const struct stat *st)
+{
+    int fd = open(name, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return NULL;
+
+    struct stat ist;
+    void *p = MAP_FAILED;
+    if (fstat(fd, &ist) == 0 && S_ISREG(ist.st_mode) && ist.st_size > 0 && trusted(&ist))
+        p = mmap(NULL, ist.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED)
+        return NULL;
+
+    struct compiled_script *script = calloc(1, sizeof *script);
+    script->image = p;
+    script->size = ist.st_size;
+    script->mapped = true;
+    if (!attach(script, path, st))
+    {
+        compiled_script_close(script);
+        return NULL;
+    }
+    return script;
+}
+
+struct compiled_script *
+script_cache_open(const char *path)
+{
+    struct stat st;
+    if (stat(path, &st) == -1 || !S_ISREG(st.st_mode))
+        return NULL;
+
+    char *real = realpath(path, NULL);
+    if (real == NULL)
+        return NULL;
+
+    char *name = cache_file_name(real);
+    struct compiled_script *script = NULL;
+    if (name != NULL)
+        script = load_image(name, real, &st);
+
+    if (script == NULL)
+    {
+        struct image_writer w;
+        memset(&w, 0, sizeof w);
+        if (compile(&w, path))
+        {
+            script = calloc(1, sizeof *script);
+            script->image = link_image(&w, real, &st, &script->size);
+            if (name != NULL)
+                save_image(name, script->image, script->size);
+            attach(script, real, &st);
+        }
+        free(w.code);
+        free(w.strings);
+        free(w.interned);
+    }
+    free(name);
+    free(real);
+    return script;
+}
+
+/* ---- running ---- */
+
+static char *
+string_at(struct compiled_script *script, uint32_t offset)
+{
+    /* the ASTs are never modified, so they may point into a read-only mapping */
+    return offset == NO_STRING ? NULL : (char *)script->strings + offset;
+}
+
+/* The flags emit_quoted wrote at *pc for n words, or NULL if none is set */
+static bool *
+quoted_at(struct arena *arena, const uint32_t **pc, size_t n)
+{
+    uint32_t nquoted = *(*pc)++;
+    if (nquoted == 0)
+        return NULL;
+    bool *quoted = arena_alloc(arena, n * sizeof *quoted);
+    memset(quoted, 0, n * sizeof *quoted);
+    for (uint32_t i = 0; i < nquoted; i++)
+        quoted[*(*pc)++] = true;
+    return quoted;
+}
+
+/* A NULL terminated array of the strings emit_words wrote at *pc */
+static char **
+words_at(struct compiled_script *script, struct arena *arena, const uint32_t **pc)
+{
+    uint32_t n = *(*pc)++;
+    char **words = arena_alloc(arena, (n + 1) * sizeof *words);
+    for (uint32_t i = 0; i < n; i++)
+        words[i] = string_at(script, *(*pc)++);
+    words[n] = NULL;
+    return words;
+}
+
+struct ast_command_line *
+compiled_script_next(struct compiled_script *script)
+{
+    if (script->lines_left == 0)
+        return NULL;
+    script->lines_left--;
+
+    const uint32_t *pc = script->code;
+    uint32_t npipes = *pc++;
+    struct arena *arena = arena_create(LINE_ARENA_SIZE(2 * npipes));
+    struct ast_command_line *cline = ast_command_line_create_empty(arena);
+    struct ast_pipeline **pipev = arena_alloc(arena, npipes * sizeof *pipev);
+
+    for (uint32_t p = 0; p < npipes; p++)
+    {
+        uint32_t flags = *pc++;
+        char *in = string_at(script, *pc++);
+        char *here = string_at(script, *pc++);
+        char *out = string_at(script, *pc++);
+        uint32_t ncmds = *pc++;
+        struct ast_pipeline *pipe = ast_pipeline_create(arena, ncmds, in, out, flags & PIPE_APPEND);
+        if (here)
+        {
+            ast_pipeline_set_here_text(pipe, here);
+        }
+        pipe->here_literal = flags & PIPE_HERE_LITERAL;
+        pipe->bg_job = flags & PIPE_BG;
+
+        for (uint32_t c = 0; c < ncmds; c++)
+        {
+            uint32_t cflags = *pc++;
+            char **assignments = NULL;
+            if (*pc == 0)
+                pc++;
+            else
+                assignments = words_at(script, arena, &pc);
+            uint32_t argc = *pc;
+            char **argv = words_at(script, arena, &pc);
+            struct ast_command *cmd = ast_pipeline_add_command(pipe, argv, assignments,
+                                                               cflags & CMD_DUP_STDERR);
+            cmd->quoted = quoted_at(arena, &pc, argc);
+        }
+        list_push_back(&cline->pipes, &pipe->elem);
+        pipev[p] = pipe;
+    }
+
+    cline->ncode = *pc++;
+    cline->nloops = *pc++;
+    cline->code = arena_alloc(arena, cline->ncode * sizeof *cline->code);
+    for (size_t i = 0; i < cline->ncode; i++)
+    {
+        struct ast_op *op = &cline->code[i];
+        memset(op, 0, sizeof *op);
+        op->opcode = *pc++;
+        switch (op->opcode)
+        {
+        case AST_OP_RUN:
+            op->pipe = pipev[*pc++];
+            break;
+        case AST_OP_JUMP:
+        case AST_OP_JUMP_IF_OK:
+        case AST_OP_JUMP_IF_FAILED:
+            op->target = *pc++;
+            break;
+        case AST_OP_SET_STATUS:
+        case AST_OP_FOR_START:
+            op->arg = *pc++;
+            break;
+        case AST_OP_FOR_NEXT:
+            op->arg = *pc++;
+            op->target = *pc++;
+            op->name = string_at(script, *pc++);
+            uint32_t nwords = *pc;
+            op->words = words_at(script, arena, &pc);
+            op->quoted = quoted_at(arena, &pc, nwords);
+            break;
+        case AST_OP_ASSIGN:
+            op->words = words_at(script, arena, &pc);
+            break;
+        }
+    }
+    script->code = pc;
+    return cline;
+}
+
+bool
+compiled_script_rest(struct compiled_script *script, size_t *offset)
+{
+    *offset = script->rest;
+    return script->rest != NO_REST;
+}
+
+void
+compiled_script_close(struct compiled_script *script)
+{
+    if (script->mapped)
+        munmap((void *)script->image, script->size);
+    else
+        free((void *)script->image);
+    free(script);
+}
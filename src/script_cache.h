@@ -0,0 +1,42 @@
+#ifndef __SCRIPT_CACHE_H
+#define __SCRIPT_CACHE_H
+
+#include <stddef.h>
+#include "shell-ast.h"
+
+/*
+ * Precompiled scripts.
+ *
+ * The first time a script file is run, every line is parsed up front and
+ * the ASTs are written to a cache file as a flat, relocatable image:
+ * counts, flags and offsets into a string table, no pointers.  Later
+ * runs map that image and turn each line back into an ast_command_line
+ * directly, without running the scanner or the parser.
+ *
+ * Cache files live in $CUSH_CACHE_DIR, else $XDG_CACHE_HOME/cush, else
+ * ~/.cache/cush; setting CUSH_CACHE_DIR to the empty string turns the
+ * cache off.  A file is used only if the path, size and modification
+ * time it records still match the script.  Compiling stops at a command
+ * that fails to parse: the image holds the lines before it and records
+ * where it starts, and the rest of the script runs line by line, which
+ * reports the error when it gets there.
+ */
+struct compiled_script;
+
+/* Return the compiled form of the script at 'path', from the cache or
+ * by compiling it now.  NULL if the file is not a regular file; errno is
+ * set if it could not be opened at all. */
+struct compiled_script *script_cache_open(const char *path);
+
+/* Return the next command line, which the caller frees with
+ * ast_command_line_free, or NULL at the end.  Its words point into the
+ * compiled image, so it must not outlive compiled_script_close. */
+struct ast_command_line *compiled_script_next(struct compiled_script *script);
+
+/* Whether compiling stopped at a command that does not parse; if so,
+ * *offset is where it starts in the script, see script_seek. */
+bool compiled_script_rest(struct compiled_script *script, size_t *offset);
+
+void compiled_script_close(struct compiled_script *script);
+
+#endif /* __SCRIPT_CACHE_H */
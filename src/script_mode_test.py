@@ -0,0 +1,114 @@
+#!/usr/bin/python
+#
+# script_mode_test: tests running a script file and -c
+#
+# The non-interactive shells are started from the shell under test
+#
+
+import sys, imp, atexit, pexpect, proc_check, signal, time, threading, tempfile, os, shutil
+from testutils import *
+
+# a script with a #! line, comments, a pipe, a background job and
+# a last line without a newline
+fd, script = tempfile.mkstemp(suffix=".cush")
+os.write(fd, "#!./cush\n"
+             "# say hello\n"
+             "echo from a script\n"
+             "  # an indented comment\n"
+             "echo to give | rev\n"
+             "sleep 0.1 &\n"
+             "echo no newline")
+os.close(fd)
+atexit.register(removefile, script)
+
+# compiled scripts are cached in a directory of our own
+cachedir = tempfile.mkdtemp()
+atexit.register(shutil.rmtree, cachedir, True)
+os.environ["CUSH_CACHE_DIR"] = cachedir
+
+console = setup_tests()
+
+# ensure that shell prints expected prompt
+expect_prompt()
+
+# the script runs in order, without prompts or job notifications
+sendline("./cush " + script)
+expect_exact("from a script\r\nevig ot\r\nno newline\r\n", "script did not run in order")
+expect_prompt()
+
+# the first run left a compiled image, and running from it gives the same result
+assert len(os.listdir(cachedir)) == 1, "script was not compiled into the cache"
+sendline("./cush " + script)
+expect_exact("from a script\r\nevig ot\r\nno newline\r\n", "cached script did not run in order")
+expect_prompt()
+
+# an edited script is compiled again
+f = open(script, "a")
+f.write("\necho edited")
+f.close()
+sendline("./cush " + script)
+expect_exact("no newline\r\nedited\r\n", "edited script ran a stale image")
+expect_prompt()
+
+# -c runs its argument
+sendline("./cush -c \"echo from -c | rev\"")
+expect_exact("c- morf", "-c did not run its command")
+expect_prompt()
+
+# the shell exits with the status of the last pipeline, or exit's argument
+sendline("./cush -c \"ls /no/such/file\"; echo status_$?")
+expect_exact("status_2", "-c did not exit with the last pipeline's status")
+expect_prompt()
+sendline("./cush -c \"exit 3\"; echo status_$?")
+expect_exact("status_3", "exit ignored its argument")
+expect_prompt()
+
+# a comment inside a loop body is not run as a command
+fd, loopscript = tempfile.mkstemp(suffix=".cush")
+os.write(fd, "for v in one two; do\n"
+             "  # print the word backwards\n"
+             "  echo $v | rev\n"
+             "done\n")
+os.close(fd)
+atexit.register(removefile, loopscript)
+sendline("./cush " + loopscript)
+expect_exact("eno\r\nowt\r\n", "a comment in a loop body was not skipped")
+expect_prompt()
+assert "#:" not in console.before, "a comment in a loop body was run"
+
+# a script with a syntax error is compiled up to the error; every run
+# takes the lines before it from the image and reports the error there
+fd, errscript = tempfile.mkstemp(suffix=".cush")
+os.write(fd, "echo before | rev\n"
+             "fi\n"
+             "echo after | rev\n")
+os.close(fd)
+atexit.register(removefile, errscript)
+nimages = len(os.listdir(cachedir))
+for run in ["first", "cached"]:
+    sendline("./cush " + errscript)
+    expect_exact("erofeb\r\nSyntax error.\r\nretfa\r\n", run + " run of a script with an error")
+    expect_prompt()
+assert len(os.listdir(cachedir)) == nimages + 1, "script with an error was not cached"
+
+# without job control, jobs stay in the shell's process group: field 5
+# of /proc/PID/stat is the pgid, of the script's shell and of cut itself
+fd, pgscript = tempfile.mkstemp(suffix=".cush")
+os.write(fd, "cut \"-d \" -f5 /proc/$$/stat /proc/self/stat\n")
+os.close(fd)
+atexit.register(removefile, pgscript)
+sendline("./cush " + pgscript)
+shell_pgid, child_pgid = expect_regex(r"(\d+)\r\n(\d+)\r\n")
+assert shell_pgid == child_pgid, "a job left the shell's process group"
+expect_prompt()
+
+# a missing script is reported
+sendline("./cush /no/such/script")
+expect_exact("/no/such/script: No such file or directory", "expected an error for a missing script")
+expect_prompt()
+
+#exit
+sendline("exit")
+expect_exact("exit\r\n", "Shell output extraneous characters")
+
+test_success()
@@ -0,0 +1,47 @@
+#!/bin/sh
+#
+# Throughput benchmark for script mode.
+#
+# Generates a command file of 100000 lines (by default) and runs it with
+# cush three times: twice as a file, first compiling it and then from the
+# precompiled image in the cache, and once through a pipe, which cush
+# streams and parses line by line.  Most lines run builtins; every 100th
+# line spawns an external command, so both the parser and the spawn path
+# are timed.
+#
+# Usage: ./scriptbench.sh [number of lines]
+
+lines=${1:-100000}
+script=$(mktemp /tmp/scriptbench.XXXXXX)
+CUSH_CACHE_DIR=$(mktemp -d /tmp/scriptbench-cache.XXXXXX)
+export CUSH_CACHE_DIR
+trap 'rm -rf "$script" "$CUSH_CACHE_DIR"' EXIT
+
+awk -v n="$lines" 'BEGIN {
+    for (i = 1; i <= n; i++) {
+        if (i % 100 == 0)
+            print "/bin/true"
+        else if (i % 3 == 0)
+            printf "test %d -gt 0\n", i
+        else if (i % 3 == 1)
+            printf "echo line %d of the benchmark > /dev/null\n", i
+        else
+            print "printf \"%s %s\\n\" key value >> /dev/null"
+    }
+}' > "$script"
+
+now() { date +%s.%N; }
+
+start=$(now)
+./cush "$script" < /dev/null
+compiled=$(now)
+./cush "$script" < /dev/null
+cached=$(now)
+cat "$script" | ./cush /dev/stdin
+end=$(now)
+
+awk -v n="$lines" -v s="$start" -v c="$compiled" -v k="$cached" -v e="$end" 'BEGIN {
+    printf "%d lines compiled: %.2f s, %.0f lines/sec\n", n, c - s, n / (c - s)
+    printf "%d lines cached:   %.2f s, %.0f lines/sec\n", n, k - c, n / (k - c)
+    printf "%d lines streamed: %.2f s, %.0f lines/sec\n", n, e - k, n / (e - k)
+}'
@@ -10,59 +10,98 @@
 #include <sys/types.h>
 #include <limits.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "shell-ast.h"
 
-/* Create new command structure.  Takes ownership of argv. */
-struct ast_command * 
-ast_command_create(char ** argv, bool dup_stderr_to_stdout)
-{
-    struct ast_command *cmd = malloc(sizeof *cmd);
-
-    cmd->argv = argv;
-    cmd->dup_stderr_to_stdout = dup_stderr_to_stdout;
-    return cmd;
-}
-
 /* Create a new pipeline */
-struct ast_pipeline * ast_pipeline_create(char *iored_input, 
+struct ast_pipeline * ast_pipeline_create(struct arena *arena,
+                                          size_t ncmds,
+                                          char *iored_input, 
                                           char *iored_output, 
                                           bool append_to_output)
 {
-    struct ast_pipeline *pipe = malloc(sizeof *pipe);
+    struct ast_pipeline *pipe = arena_alloc(arena, sizeof *pipe);
 
+    pipe->cmdv = arena_alloc(arena, ncmds * sizeof *pipe->cmdv);
+    pipe->ncmds = 0;
     list_init(&pipe->commands);
     pipe->iored_output = iored_output;
     pipe->iored_input = iored_input;
+    pipe->here = NULL;
+    pipe->nhere = 0;
+    pipe->here_literal = false;
     pipe->append_to_output = append_to_output;
     pipe->bg_job = false;
+    pipe->arena = arena;
     return pipe;
 }
 
-/* Add a new command to this pipeline */
-void
-ast_pipeline_add_command(struct ast_pipeline *pipe, struct ast_command *cmd)
+/* Add a new command to this pipeline, in the next slot of cmdv.
+ * The caller sized cmdv when creating the pipeline. */
+struct ast_command *
+ast_pipeline_add_command(struct ast_pipeline *pipe, char ** argv,
+                         char ** assignments, bool dup_stderr_to_stdout)
 {
+    struct ast_command *cmd = &pipe->cmdv[pipe->ncmds++];
+
+    cmd->argv = argv;
+    cmd->assignments = assignments;
+    cmd->quoted = NULL;
+    cmd->dup_stderr_to_stdout = dup_stderr_to_stdout;
     list_push_back(&pipe->commands, &cmd->elem);
+    return cmd;
+}
+
+char *
+ast_pipeline_here_text(struct ast_pipeline *pipe, struct arena *arena)
+{
+    size_t len = 0;
+    for (size_t i = 0; i < pipe->nhere; i++)
+        len += pipe->here[i].iov_len;
+
+    char *text = arena_alloc(arena, len + 1), *p = text;
+    for (size_t i = 0; i < pipe->nhere; i++) {
+        memcpy(p, pipe->here[i].iov_base, pipe->here[i].iov_len);
+        p += pipe->here[i].iov_len;
+    }
+    *p = '\0';
+    return text;
+}
+
+void
+ast_pipeline_set_here_text(struct ast_pipeline *pipe, char *text)
+{
+    pipe->here = arena_alloc(pipe->arena, sizeof *pipe->here);
+    pipe->here->iov_base = text;
+    pipe->here->iov_len = strlen(text);
+    pipe->nhere = 1;
 }
 
 /* Create an empty command line */
 struct ast_command_line *
-ast_command_line_create_empty(void)
+ast_command_line_create_empty(struct arena *arena)
 {
-    struct ast_command_line *cmdline = malloc(sizeof *cmdline);
+    struct ast_command_line *cmdline = arena_alloc(arena, sizeof *cmdline);
 
     list_init(&cmdline->pipes);
+    cmdline->code = NULL;
+    cmdline->ncode = 0;
+    cmdline->nloops = 0;
+    cmdline->arena = arena;
     return cmdline;
 }
 
 /* Create a command line with a single pipeline */
 struct ast_command_line *
-ast_command_line_create(struct ast_pipeline *pipe)
+ast_command_line_create(struct arena *arena, struct ast_pipeline *pipe)
 {
-    struct ast_command_line *cmdline = ast_command_line_create_empty();
+    struct ast_command_line *cmdline = ast_command_line_create_empty(arena);
 
     list_push_back(&cmdline->pipes, &pipe->elem);
+    cmdline->code = arena_alloc(arena, sizeof *cmdline->code);
+    cmdline->code[0] = (struct ast_op) { .opcode = AST_OP_RUN, .pipe = pipe };
+    cmdline->ncode = 1;
     return cmdline;
 }
 
@@ -73,6 +112,8 @@ ast_command_print(struct ast_command *cmd)
     char **p = cmd->argv;
 
     printf("  Command:");
+    for (char **a = cmd->assignments; a && *a; a++)
+        printf(" %s", *a);
     while (*p)
         printf(" %s", *p++);
 
@@ -86,16 +127,10 @@ ast_command_print(struct ast_command *cmd)
 void
 ast_pipeline_print(struct ast_pipeline *pipe)
 {
-    int i = 1;
-
-    printf(" Pipeline consists of %ld commands\n", list_size(&pipe->commands));
-    for (struct list_elem * e = list_begin(&pipe->commands); 
-         e != list_end(&pipe->commands); 
-         e = list_next(e)) {
-        struct ast_command *cmd = list_entry(e, struct ast_command, elem);
-
-        printf(" %d. ", i++);
-        ast_command_print(cmd);
+    printf(" Pipeline consists of %zu commands\n", pipe->ncmds);
+    for (size_t i = 0; i < pipe->ncmds; i++) {
+        printf(" %zu. ", i + 1);
+        ast_command_print(&pipe->cmdv[i]);
     }
 
     if (pipe->iored_output)
@@ -106,6 +141,12 @@ ast_pipeline_print(struct ast_pipeline *pipe)
     if (pipe->iored_input)
         printf("  stdin of the first command reads from %s\n", pipe->iored_input);
 
+    if (pipe->here) {
+        printf("  stdin of the first command reads the text:\n");
+        for (size_t i = 0; i < pipe->nhere; i++)
+            printf("%.*s", (int)pipe->here[i].iov_len, (char *)pipe->here[i].iov_base);
+    }
+
     if (pipe->bg_job)
         printf("  - is a background job\n");
     else
@@ -128,42 +169,30 @@ ast_command_line_print(struct ast_command_line *cmdline)
     printf("==========================================\n");
 }
 
-/* Deallocation functions. */
-void 
-ast_command_line_free(struct ast_command_line *cmdline)
+struct ast_command_line *
+ast_command_line_get(struct ast_command_line *cmdline)
 {
-    for (struct list_elem * e = list_begin(&cmdline->pipes); e != list_end(&cmdline->pipes); ) {
-        struct ast_pipeline *pipe = list_entry(e, struct ast_pipeline, elem);
-        e = list_remove(e);
-        ast_pipeline_free(pipe);
-    }
-    free(cmdline);
+    arena_get(cmdline->arena);
+    return cmdline;
 }
 
-void 
-ast_pipeline_free(struct ast_pipeline *pipe)
+struct ast_pipeline *
+ast_pipeline_get(struct ast_pipeline *pipe)
 {
-    for (struct list_elem * e = list_begin(&pipe->commands); e != list_end(&pipe->commands); ) {
-        struct ast_command *cmd = list_entry(e, struct ast_command, elem);
-        e = list_remove(e);
-        ast_command_free(cmd);
-    }
-    if (pipe->iored_input)
-        free(pipe->iored_input);
-
-    if (pipe->iored_output)
-        free(pipe->iored_output);
+    arena_get(pipe->arena);
+    return pipe;
+}
 
-    free(pipe);
+/* Deallocation functions.  Nodes live in the arena and are not freed
+ * one by one; each owner just drops its reference. */
+void 
+ast_command_line_free(struct ast_command_line *cmdline)
+{
+    arena_put(cmdline->arena);
 }
 
 void 
-ast_command_free(struct ast_command * cmd)
+ast_pipeline_free(struct ast_pipeline *pipe)
 {
-    char ** p = cmd->argv;
-    while (*p) {
-        free(*p++);
-    }
-    free(cmd->argv);
-    free(cmd);
+    arena_put(pipe->arena);
 }
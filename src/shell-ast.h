@@ -1,29 +1,84 @@
 #ifndef __SHELL_AST_H
 #define __SHELL_AST_H
 
+#include <sys/uio.h>
 #include "list.h"
+#include "arena.h"
 
 /* Forward declarations. */
 struct ast_command;
 struct ast_pipeline;
 struct ast_command_line;
 
+/*
+ * Everything parsed from one command line lives in one arena: the copy
+ * of the line the parser scans in place (which the words and file names
+ * point into), the argv arrays and all nodes.  The command line holds a
+ * reference, and so does anyone who keeps one of its pipelines, e.g. the
+ * job a pipeline became.  A parsed command line is never modified, so it
+ * can be shared, see parse_cache.h.
+ */
+
+/*
+ * Control flow (if, while, for, && and ||) is compiled into a flat array
+ * of operations when the line is parsed, so running a loop again never
+ * reparses it.  The operations run in order; each pipeline sets the exit
+ * status, which the conditional jumps test.  A line without control flow
+ * is just one AST_OP_RUN per pipeline.
+ */
+enum ast_opcode {
+    AST_OP_RUN,             /* Run 'pipe' */
+    AST_OP_JUMP,            /* Continue at 'target' */
+    AST_OP_JUMP_IF_OK,      /* ... if the exit status is 0 */
+    AST_OP_JUMP_IF_FAILED,  /* ... if it is not 0 */
+    AST_OP_SET_STATUS,      /* Set the exit status to 'arg' */
+    AST_OP_FOR_START,       /* Rewind the loop counter 'arg' */
+    AST_OP_FOR_NEXT,        /* Set 'name' to the next of 'words' and advance
+                               loop counter 'arg', or continue at 'target'
+                               once all words were used */
+    AST_OP_ASSIGN,          /* Set the variables in 'words', each NAME=value */
+};
+
+struct ast_op {
+    enum ast_opcode opcode;
+    int arg;
+    size_t target;           /* Index of an operation, or ncode for the end */
+    struct ast_pipeline *pipe;
+    char *name;
+    char **words;            /* NULL terminated */
+    bool *quoted;            /* NULL, or which of 'words' were quoted */
+};
+
 /* A command line may contain multiple pipelines. */
 struct ast_command_line {
-    struct list/* <ast_pipeline> */ pipes;        /* List of pipelines */
+    struct list/* <ast_pipeline> */ pipes;        /* List of pipelines, in order */
+    struct ast_op *code;     /* What to run, see above */
+    size_t ncode;
+    int nloops;              /* Number of loop counters the code uses */
+    struct arena *arena;     /* Holds this command line */
 };
 
 /* A pipeline is a list of one or more commands. 
  * For the purposes of job control, a pipeline forms one job.
  */
 struct ast_pipeline {
-    struct list/* <ast_command> */ commands;    /* List of commands */
+    struct ast_command *cmdv;  /* Array of the commands, in order */
+    size_t ncmds;              /* Number of commands in cmdv */
+    struct list/* <ast_command> */ commands;    /* The same commands as a list */
     char *iored_input;       /* If non-NULL, first command should read from
                                 file 'iored_input' */
+    struct iovec *here;      /* If non-NULL, first command reads the text
+                                of these nhere slices, from a here-document
+                                or here-string.  A body is not copied: the
+                                slices point into the copies of its lines */
+    size_t nhere;
+    bool here_literal;       /* The text is not expanded, since the
+                                here-document's delimiter was quoted */
     char *iored_output;      /* If non-NULL, last command should write to
                                 file 'iored_output' */
     bool append_to_output;   /* True if user typed >> to append */
     bool bg_job;             /* True if user entered & */
+    struct arena *arena;     /* Holds this pipeline */
     struct list_elem elem;   /* Link element. */
 };
 
@@ -31,40 +86,96 @@ struct ast_pipeline {
 struct ast_command {
     char **argv;             /* NULL terminated array of pointers to words
                                 making up this command. */
+    char **assignments;      /* NAME=value words before the command, for its
+                                environment only; NULL terminated, or NULL
+                                if there are none */
+    bool *quoted;            /* NULL if no word of argv was quoted; else
+                                quoted[i] is true if argv[i] was, which
+                                keeps it from being globbed */
     bool dup_stderr_to_stdout; /* True if stderr should be redirected as well */
     struct list_elem elem;   /* Link element to link commands in pipeline. */
 };
 
-/* Create new command structure and initialize it */
-struct ast_command * ast_command_create(char ** argv,
-                                        bool dup_stderr_to_stdout);
-
-/* Create a new pipeline containing only one command */
-struct ast_pipeline * ast_pipeline_create(char *iored_input, 
+/* Create a new, empty pipeline with room for ncmds commands */
+struct ast_pipeline * ast_pipeline_create(struct arena *arena,
+                                          size_t ncmds,
+                                          char *iored_input, 
                                           char *iored_output, 
                                           bool append_to_output);
 
-/* Add a new command to this pipeline */
-void ast_pipeline_add_command(struct ast_pipeline *pipe, struct ast_command *cmd);
+/* Add a new command to this pipeline.  argv and assignments must live
+ * in its arena. */
+struct ast_command * ast_pipeline_add_command(struct ast_pipeline *pipe,
+                                              char ** argv,
+                                              char ** assignments,
+                                              bool dup_stderr_to_stdout);
+
+/* Create an empty command line, without code */
+struct ast_command_line * ast_command_line_create_empty(struct arena *arena);
+
+/* The text a pipeline reads, joined into one string allocated from arena */
+char * ast_pipeline_here_text(struct ast_pipeline *pipe, struct arena *arena);
 
-/* Create an empty command line */
-struct ast_command_line * ast_command_line_create_empty(void);
+/* Let a pipeline read text, which must live as long as the pipeline */
+void ast_pipeline_set_here_text(struct ast_pipeline *pipe, char *text);
 
-/* Create a command line with a single pipeline */
-struct ast_command_line * ast_command_line_create(struct ast_pipeline *pipe);
+/* Create a command line with a single pipeline, and code that runs it */
+struct ast_command_line * ast_command_line_create(struct arena *arena,
+                                                  struct ast_pipeline *pipe);
 
-/* Deallocation functions */
+/* Take a reference to a command line or a pipeline.  A pipeline stays
+ * valid after its command line is freed for as long as it is held. */
+struct ast_command_line * ast_command_line_get(struct ast_command_line *);
+struct ast_pipeline * ast_pipeline_get(struct ast_pipeline *);
+
+/* Deallocation functions; each drops one reference. */
 void ast_command_line_free(struct ast_command_line *);
 void ast_pipeline_free(struct ast_pipeline *);
-void ast_command_free(struct ast_command *);
 
 /* Print functions */
 void ast_command_print(struct ast_command *cmd);
 void ast_pipeline_print(struct ast_pipeline *pipe);
 void ast_command_line_print(struct ast_command_line *line);
 
-/* Parse a command line.  Implemented in shell-grammar.y */
-struct ast_command_line * ast_parse_command_line(char * line);
+/* Parse a command line.  Implemented in shell-grammar.y
+ * Safe to call from any thread; each thread parses with a context of its own. */
+struct ast_command_line * ast_parse_command_line(const char * line);
+
+/* The same, but syntax errors are not reported */
+struct ast_command_line * ast_parse_command_line_quietly(const char * line);
+
+/* True if the last of the above calls in this thread failed only because
+ * the line ended in the middle of a command, e.g. an 'if' without its
+ * 'fi' or a trailing '&&'.  The caller may go on with the next line. */
+bool ast_parse_incomplete(void);
+
+/* Go on with the next line of a command whose parse was incomplete.
+ * Only the new line is scanned; the parser kept the state of the lines
+ * before, and reports errors as the parse it continues does.  Returns
+ * the command line once it is complete. */
+struct ast_command_line * ast_parse_continued_line(const char * line);
+
+/* A parser context holds the scanner and all other state of a parse.
+ * One context parses one line at a time; contexts are independent, so a
+ * thread that parses many lines can keep its own. */
+struct ast_parser;
+
+struct ast_parser * ast_parser_create(void);
+void ast_parser_destroy(struct ast_parser *parser);
+
+/* Parse a line with the given context.  Syntax errors are printed to
+ * stderr if report_errors is set. */
+struct ast_command_line * ast_parser_parse(struct ast_parser *parser,
+                                           const char * line,
+                                           bool report_errors);
+
+/* Whether the last failed parse with this context was incomplete */
+bool ast_parser_incomplete(struct ast_parser *parser);
+
+/* Go on with the next line of an incomplete parse, as
+ * ast_parse_continued_line does */
+struct ast_command_line * ast_parser_continue(struct ast_parser *parser,
+                                              const char * line);
 
 /** ----------------------------------------------------------- */
 #endif /* __SHELL_AST_H */
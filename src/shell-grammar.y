@@ -9,15 +9,17 @@
  * This is based on an assignment as an undergraduate in 1993 
  * as an undergraduate student at Technische Universitaet Berlin.
  *
- * Known bugs: leaks memory when parse errors occur.
+ * Everything built while parsing a line comes from that line's arena,
+ * so a parse error releases it all at once.
  */
 %{
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <pthread.h>
 #define YYDEBUG	1
 int yydebug;
-void yyerror(const char *msg);
-int yylex(void);
 
 /*
  * Error messages, csh-style
@@ -26,17 +28,91 @@ int yylex(void);
 #define INVNUL  "Invalid null command."
 #define AMBINP  "Ambiguous input redirect."
 #define AMBOUT  "Ambiguous output redirect."
+#define BGCTL   "Only a pipeline can run in the background."
+#define ILLVAR  "Illegal variable name."
+#define SYNERR  "Syntax error."
 
 #include "shell-ast.h"
-#include <obstack.h>
 #include <assert.h>
 
-#define obstack_chunk_alloc malloc
-#define obstack_chunk_free free
+/* The scanner's handle, as flex declares it */
+#define YY_TYPEDEF_YY_SCANNER_T
+typedef void *yyscan_t;
+
+/* The parser's state between tokens, as bison declares it */
+struct yypstate;
+
+/*
+ * All state of a parse.  The parser is a pure parser and the scanner a
+ * reentrant one, so two threads can parse at the same time as long as
+ * each uses its own context.
+ *
+ * The parser is a push parser, fed one line at a time: if a line ends
+ * in the middle of a command, the parse stops there with its state kept
+ * here, and resumes with the next line, so no line is scanned twice.
+ */
+struct here;
+
+struct ast_parser {
+    yyscan_t scanner;
+    struct yypstate *pstate;
+    struct arena *arena;            /* Arena of the lines being parsed */
+    char **word_ends;               /* See lex_word */
+    size_t nword_ends, max_word_ends;
+    char **quoted_words;            /* See lex_quoted_word */
+    size_t nquoted_words, max_quoted_words;
+    struct ast_command_line *result;
+    int nloops;                     /* Loop counters used so far */
+    struct here *heres, **last_here; /* Here-documents and -strings */
+    struct here *pending_here;      /* First here-document without a body */
+    int nopen;                      /* Compound commands and && || lists
+                                       that are not finished yet */
+    bool report_errors;
+    bool reported;                  /* An error was found and reported */
+    bool incomplete;                /* The last parse ended early */
+};
+
+struct word {
+    char *word;
+    struct word *next;
+};
+
+/*
+ * A here-document or here-string.  The body of a here-document is in the
+ * lines that follow the command, which the scanner reads only after the
+ * pipeline was built, so pipelines are pointed at their text once the
+ * whole line is parsed.  The body is never copied: it is recorded as
+ * slices of the copies of its lines, one for each run of lines that
+ * were fed together.
+ */
+struct here_slice {
+    char *text;
+    size_t len;
+    struct here_slice *next;
+};
+
+struct here {
+    char *text;             /* The word of a here-string */
+    struct here_slice *body, *last_slice;   /* A here-document's body */
+    size_t nslices;
+    const char *delim;      /* A here-document's delimiter, not terminated */
+    size_t delim_len;
+    bool is_string;         /* <<< word, which is fed with a newline */
+    bool literal;           /* The delimiter was quoted: no expansion */
+    bool complete;          /* The delimiter line was found */
+    struct ast_pipeline *pipe;  /* The pipeline that reads it */
+    struct here *next;
+};
 
 struct cmd_helper {
-    struct obstack words;   /* an obstack of char * to collect argv */
+    struct word *words;     /* list of words to collect argv */
+    struct word **last_word;
+    size_t nwords;
+    struct word *assigns;   /* NAME=value words before the first word */
+    struct word **last_assign;
+    size_t nassigns;
     char *iored_input;
+    struct here *here;      /* Input from a here-document or here-string */
     char *iored_output;
     bool append_to_output;
     bool redirect_stderr;
@@ -45,60 +121,129 @@ struct cmd_helper {
 
 struct pipe_helper {
     struct list commands;
+    size_t ncommands;
 };
 
 static struct pipe_helper *
-init_pipe()
+init_pipe(struct ast_parser *parser)
 {
-    struct pipe_helper * pipe = calloc(1, sizeof *pipe);
+    struct pipe_helper * pipe = arena_alloc(parser->arena, sizeof *pipe);
     list_init(&pipe->commands);
+    pipe->ncommands = 0;
     return pipe;
 }
 
+/* Append a word to a list of words */
+static void
+append_word(struct ast_parser *parser, struct word ***last, size_t *n, char *word)
+{
+    struct word *w = arena_alloc(parser->arena, sizeof *w);
+    w->word = word;
+    w->next = NULL;
+    **last = w;
+    *last = &w->next;
+    (*n)++;
+}
+
+/* Append a word to the command's argv */
+static void
+add_word(struct ast_parser *parser, struct cmd_helper *cmd, char *word)
+{
+    append_word(parser, &cmd->last_word, &cmd->nwords, word);
+}
+
+/* An assignment is one only before the command name; after it, it is
+ * an argument like any other word */
+static void
+add_assignment(struct ast_parser *parser, struct cmd_helper *cmd, char *word)
+{
+    if (cmd->nwords > 0)
+        add_word(parser, cmd, word);
+    else
+        append_word(parser, &cmd->last_assign, &cmd->nassigns, word);
+}
+
 /* Initialize cmd_helper and, optionally, set first argv */
 static struct cmd_helper *
-init_cmd(char *firstcmd, 
+init_cmd(struct ast_parser *parser, char *firstcmd, 
          char *iored_input, char *iored_output, 
          bool append_to_output, bool include_stderr)
 {
-    struct cmd_helper * cmd = malloc(sizeof *cmd);
-    obstack_init(&cmd->words);
+    struct cmd_helper * cmd = arena_alloc(parser->arena, sizeof *cmd);
+    cmd->words = NULL;
+    cmd->last_word = &cmd->words;
+    cmd->nwords = 0;
+    cmd->assigns = NULL;
+    cmd->last_assign = &cmd->assigns;
+    cmd->nassigns = 0;
     if (firstcmd)
-        obstack_ptr_grow(&cmd->words, firstcmd);
+        add_word(parser, cmd, firstcmd);
 
     cmd->iored_output = iored_output;
     cmd->iored_input = iored_input;
+    cmd->here = NULL;
     cmd->append_to_output = append_to_output;
     cmd->redirect_stderr = include_stderr;
     return cmd;
 }
 
 /* print error message */
-static void p_error(char *msg);
+static void p_error(struct ast_parser *parser, char *msg);
 
-/* Convert cmd_helper to ast_command.
- * Ensures NULL-terminated argv[] array
- */
-static struct ast_command * 
-make_ast_command(struct cmd_helper *cmd)
+/* Collect a list of n words into a NULL-terminated array */
+static char **
+make_argv(struct ast_parser *parser, struct word *words, size_t n)
 {
-    obstack_ptr_grow(&cmd->words, NULL);
+    char **argv = arena_alloc(parser->arena, (n + 1) * sizeof *argv);
+    char **p = argv;
+    for (struct word *w = words; w != NULL; w = w->next)
+        *p++ = w->word;
+    *p = NULL;
+    return argv;
+}
 
-    int sz = obstack_object_size(&cmd->words);
-    char **argv = malloc(sz);
-    memcpy(argv, obstack_finish(&cmd->words), sz);
-    obstack_free(&cmd->words, NULL);
+static int
+compare_words(const void *a, const void *b)
+{
+    const char *x = *(char *const *)a, *y = *(char *const *)b;
+    return x < y ? -1 : x > y;
+}
+
+/* Which of a list of n words were quoted, or NULL if none was */
+static bool *
+make_quoted(struct ast_parser *parser, struct word *words, size_t n)
+{
+    if (parser->nquoted_words == 0)
+        return NULL;
 
-    if (*argv == NULL) {
-        free(argv);
-        return NULL; 
+    bool *quoted = arena_alloc(parser->arena, n * sizeof *quoted);
+    bool any = false;
+    bool *q = quoted;
+    for (struct word *w = words; w != NULL; w = w->next) {
+        /* the scanner records quoted words from left to right */
+        *q = bsearch(&w->word, parser->quoted_words, parser->nquoted_words,
+                     sizeof *parser->quoted_words, compare_words) != NULL;
+        any |= *q++;
     }
+    return any ? quoted : NULL;
+}
 
-    return ast_command_create(argv, cmd->redirect_stderr);
+/* Convert cmd_helper to the next command of pipeline pipe. */
+static void
+add_ast_command(struct ast_parser *parser, struct ast_pipeline *pipe, struct cmd_helper *cmd)
+{
+    char **assignments = NULL;
+    if (cmd->nassigns > 0)
+        assignments = make_argv(parser, cmd->assigns, cmd->nassigns);
+    struct ast_command *command =
+        ast_pipeline_add_command(pipe, make_argv(parser, cmd->words, cmd->nwords),
+                                 assignments, cmd->redirect_stderr);
+    command->quoted = make_quoted(parser, cmd->words, cmd->nwords);
 }
 
 static bool
-add_to_pipeline(struct pipe_helper *pipe,
+add_to_pipeline(struct ast_parser *parser,
+                struct pipe_helper *pipe,
                 struct cmd_helper *cmd,
                 bool redirect_stderr)
 {
@@ -107,207 +252,808 @@ add_to_pipeline(struct pipe_helper *pipe,
         last = list_entry(list_back(&pipe->commands), 
                           struct cmd_helper, elem);
         /* Error: 'ls >x | wc' */
-        if (last->iored_output) { p_error(AMBOUT); return false; }
+        if (last->iored_output) { p_error(parser, AMBOUT); return false; }
         last->redirect_stderr = redirect_stderr;
 
         /* Error: 'ls | <x wc' */
-        if (cmd->iored_input) { p_error(AMBINP); return false; }
+        if (cmd->iored_input || cmd->here) { p_error(parser, AMBINP); return false; }
+
+        /* Error: 'x=1 | wc', 'ls | x=1' */
+        if (last->nwords == 0 || cmd->nwords == 0) { p_error(parser, INVNUL); return false; }
     }
 
-    int sz = obstack_object_size(&cmd->words);
-    if (sz == 0) { p_error(INVNUL); return false; }
+    if (cmd->nwords == 0 && cmd->nassigns == 0) { p_error(parser, INVNUL); return false; }
+
+    /* Error: 'x=1 >f'; only a command takes redirections */
+    if (cmd->nwords == 0 && (cmd->iored_input || cmd->here || cmd->iored_output)) {
+        p_error(parser, INVNUL);
+        return false;
+    }
 
     list_push_back(&pipe->commands, &cmd->elem);
+    pipe->ncommands++;
+    return true;
+}
+
+/*
+ * Code is generated bottom up as the parser reduces: each construct
+ * yields a fragment, a list of operations that the constructs around it
+ * are glued onto.  Jumps point at label nodes, which turn into indices
+ * once the whole line is known, see link_code.
+ */
+struct op_node {
+    struct ast_op op;
+    bool is_label;
+    struct op_node *target;         /* Label a jump goes to */
+    size_t index;                   /* Position in the final array */
+    struct op_node *next;
+};
+
+struct code {
+    struct op_node *first, *last;
+    struct ast_pipeline *single;    /* The pipeline, if that is all it runs */
+};
+
+static struct code
+code_empty(void)
+{
+    return (struct code) { NULL, NULL, NULL };
+}
+
+static struct code
+code_node(struct ast_parser *parser, enum ast_opcode opcode, bool is_label)
+{
+    struct op_node *n = arena_alloc(parser->arena, sizeof *n);
+    memset(n, 0, sizeof *n);
+    n->op.opcode = opcode;
+    n->is_label = is_label;
+    return (struct code) { n, n, NULL };
+}
+
+static struct code
+code_op(struct ast_parser *parser, enum ast_opcode opcode, int arg)
+{
+    struct code c = code_node(parser, opcode, false);
+    c.first->op.arg = arg;
+    return c;
+}
+
+static struct code
+code_label(struct ast_parser *parser)
+{
+    return code_node(parser, AST_OP_JUMP, true);
+}
+
+static struct code
+code_jump(struct ast_parser *parser, enum ast_opcode opcode, struct code label)
+{
+    struct code c = code_node(parser, opcode, false);
+    c.first->target = label.first;
+    return c;
+}
+
+static struct code
+code_run(struct ast_parser *parser, struct ast_pipeline *pipe)
+{
+    struct code c = code_node(parser, AST_OP_RUN, false);
+    c.first->op.pipe = pipe;
+    c.single = pipe;
+    return c;
+}
+
+/* Build the AST of a pipeline and the code that runs it.  A pipeline
+ * that is only assignments, 'x=1 y=2', sets variables instead. */
+static struct code
+code_pipeline(struct ast_parser *parser, struct pipe_helper *pipe)
+{
+    assert (!list_empty(&pipe->commands));
+    struct cmd_helper * first;
+    first = list_entry(list_front(&pipe->commands), struct cmd_helper, elem);
+    struct cmd_helper * last;
+    last = list_entry(list_back(&pipe->commands), struct cmd_helper, elem);
+
+    if (first->nwords == 0) {
+        struct code c = code_node(parser, AST_OP_ASSIGN, false);
+        c.first->op.words = make_argv(parser, first->assigns, first->nassigns);
+        return c;
+    }
+
+    struct ast_pipeline *ast_pipe = ast_pipeline_create(
+        parser->arena,
+        pipe->ncommands,
+        first->iored_input,
+        last->iored_output,
+        last->append_to_output
+    );
+    if (first->here)
+        first->here->pipe = ast_pipe;
+    for (struct list_elem * e = list_begin(&pipe->commands);
+                            e != list_end(&pipe->commands);
+                            e = list_next(e)) {
+        struct cmd_helper * cmd = list_entry(e, struct cmd_helper, elem);
+        add_ast_command(parser, ast_pipe, cmd);
+    }
+    return code_run(parser, ast_pipe);
+}
+
+/* Glue b onto the end of a */
+static struct code
+code_concat(struct code a, struct code b)
+{
+    if (a.first == NULL)
+        return b;
+    if (b.first == NULL)
+        return a;
+    a.last->next = b.first;
+    a.last = b.last;
+    a.single = NULL;
+    return a;
+}
+
+/* a && b and a || b: skip b if a's status makes jump 'skip' jump */
+static struct code
+code_and_or(struct ast_parser *parser, struct code a, enum ast_opcode skip, struct code b)
+{
+    struct code end = code_label(parser);
+    struct code c = code_concat(a, code_jump(parser, skip, end));
+    c = code_concat(c, b);
+    return code_concat(c, end);
+}
+
+/* if cond; then body; else otherwise; fi, also used for elif */
+static struct code
+code_if(struct ast_parser *parser, struct code cond, struct code body, struct code otherwise)
+{
+    struct code other = code_label(parser), end = code_label(parser);
+    struct code c = code_concat(cond, code_jump(parser, AST_OP_JUMP_IF_FAILED, other));
+    c = code_concat(c, body);
+    c = code_concat(c, code_jump(parser, AST_OP_JUMP, end));
+    c = code_concat(c, other);
+    c = code_concat(c, otherwise);
+    return code_concat(c, end);
+}
+
+/* while cond; do body; done */
+static struct code
+code_while(struct ast_parser *parser, struct code cond, struct code body)
+{
+    struct code top = code_label(parser), end = code_label(parser);
+    struct code c = code_concat(top, cond);
+    c = code_concat(c, code_jump(parser, AST_OP_JUMP_IF_FAILED, end));
+    c = code_concat(c, body);
+    c = code_concat(c, code_jump(parser, AST_OP_JUMP, top));
+    c = code_concat(c, end);
+    return code_concat(c, code_op(parser, AST_OP_SET_STATUS, 0));
+}
+
+/* for name in words; do body; done */
+static struct code
+code_for(struct ast_parser *parser, char *name, struct cmd_helper *words, struct code body)
+{
+    int counter = parser->nloops++;
+    struct code top = code_label(parser), end = code_label(parser);
+    struct code next = code_jump(parser, AST_OP_FOR_NEXT, end);
+    next.first->op.arg = counter;
+    next.first->op.name = name;
+    next.first->op.words = make_argv(parser, words->words, words->nwords);
+    next.first->op.quoted = make_quoted(parser, words->words, words->nwords);
+
+    struct code c = code_op(parser, AST_OP_FOR_START, counter);
+    c = code_concat(c, top);
+    c = code_concat(c, next);
+    c = code_concat(c, body);
+    c = code_concat(c, code_jump(parser, AST_OP_JUMP, top));
+    c = code_concat(c, end);
+    return code_concat(c, code_op(parser, AST_OP_SET_STATUS, 0));
+}
+
+/* Mark code run with & as a background job */
+static bool
+set_background(struct ast_parser *parser, struct code code)
+{
+    if (code.single == NULL) { p_error(parser, BGCTL); return false; }
+    code.single->bg_job = true;
+    return true;
+}
+
+/* A for loop variable must be a name: letters, digits and _.
+ * Assignments are checked by the scanner. */
+static bool
+is_name(const char *word)
+{
+    if (!(isalpha((unsigned char)*word) || *word == '_'))
+        return false;
+    while (*++word)
+        if (!(isalnum((unsigned char)*word) || *word == '_'))
+            return false;
+    return true;
+}
+
+/* Check the names of the for loops in a parsed line */
+static bool
+check_names(struct ast_parser *parser, struct ast_command_line *cline)
+{
+    for (size_t i = 0; i < cline->ncode; i++)
+        if (cline->code[i].opcode == AST_OP_FOR_NEXT && !is_name(cline->code[i].name)) {
+            p_error(parser, ILLVAR);
+            return false;
+        }
     return true;
 }
 
-/* Called by parser when command line is complete */
-static void cmdline_complete(struct ast_command_line *);
+/* Lay the code out in an array, now that jump targets are known.
+ * The pipelines are listed in the order they appear. */
+static struct ast_command_line *
+link_code(struct ast_parser *parser, struct code code)
+{
+    struct ast_command_line *cline = ast_command_line_create_empty(parser->arena);
+    size_t n = 0;
+    for (struct op_node *op = code.first; op != NULL; op = op->next) {
+        op->index = n;
+        if (!op->is_label)
+            n++;
+    }
+
+    cline->code = arena_alloc(parser->arena, n * sizeof *cline->code);
+    cline->ncode = n;
+    cline->nloops = parser->nloops;
+    struct ast_op *p = cline->code;
+    for (struct op_node *op = code.first; op != NULL; op = op->next) {
+        if (op->is_label)
+            continue;
+        if (op->target)
+            op->op.target = op->target->index;
+        if (op->op.opcode == AST_OP_RUN)
+            list_push_back(&cline->pipes, &op->op.pipe->elem);
+        *p++ = op->op;
+    }
+    return cline;
+}
+
+static char *lex_word(struct ast_parser *parser, char *word, size_t len);
 
-/* work-around for bug in flex 2.31 and later */
-static void yyunput (int c,char *buf_ptr  ) __attribute__((unused));
+static void
+add_here(struct ast_parser *parser, struct here *h)
+{
+    h->pipe = NULL;
+    h->complete = false;
+    h->next = NULL;
+    *parser->last_here = h;
+    parser->last_here = &h->next;
+}
+
+/* <<DELIM, scanned as one token with its delimiter.  The body starts
+ * with the next line. */
+static struct here *
+here_doc(struct ast_parser *parser, char *token, size_t len)
+{
+    char *delim = token + 2;
+    while (*delim == ' ' || *delim == '\t')
+        delim++;
+    size_t delim_len = token + len - delim;
+    bool literal = false;
+    if (delim_len >= 2 && (*delim == '"' || *delim == '\'') && delim[delim_len - 1] == *delim) {
+        delim++;
+        delim_len -= 2;
+        literal = true;
+    }
+
+    struct here *h = arena_alloc(parser->arena, sizeof *h);
+    h->text = NULL;
+    h->body = h->last_slice = NULL;
+    h->nslices = 0;
+    h->delim = delim;
+    h->delim_len = delim_len;
+    h->is_string = false;
+    h->literal = literal;
+    add_here(parser, h);
+    if (parser->pending_here == NULL)
+        parser->pending_here = h;
+    return h;
+}
+
+/* <<< word */
+static struct here *
+here_string(struct ast_parser *parser, char *word)
+{
+    struct here *h = arena_alloc(parser->arena, sizeof *h);
+    h->text = word;
+    h->is_string = true;
+    h->literal = false;
+    add_here(parser, h);
+    h->complete = true;
+    return h;
+}
+
+/* True if the lines after the current one start a here-document body */
+static bool
+here_pending(struct ast_parser *parser)
+{
+    return parser->pending_here != NULL;
+}
+
+/* Take a line, ending in a newline, of a here-document body.  Returns
+ * true once the last pending body has ended. */
+static bool
+here_line(struct ast_parser *parser, char *line, size_t len)
+{
+    struct here *h = parser->pending_here;
+    if (len - 1 != h->delim_len || memcmp(line, h->delim, h->delim_len) != 0) {
+        struct here_slice *last = h->last_slice;
+        if (last != NULL && last->text + last->len == line) {
+            /* the line follows the last one in the same copy */
+            last->len += len;
+            return false;
+        }
+        struct here_slice *slice = arena_alloc(parser->arena, sizeof *slice);
+        slice->text = line;
+        slice->len = len;
+        slice->next = NULL;
+        if (last != NULL)
+            last->next = slice;
+        else
+            h->body = slice;
+        h->last_slice = slice;
+        h->nslices++;
+        return false;
+    }
+
+    h->complete = true;
+    while (h != NULL && h->complete)
+        h = h->next;
+    parser->pending_here = h;
+    return h == NULL;
+}
+
+/* Once the words are terminated, give the pipelines their text */
+static void
+link_heres(struct ast_parser *parser)
+{
+    for (struct here *h = parser->heres; h != NULL; h = h->next) {
+        if (h->pipe == NULL)
+            continue;
+        size_t n = h->is_string ? 2 : h->nslices;
+        struct iovec *iov = arena_alloc(parser->arena, (n ? n : 1) * sizeof *iov);
+        if (h->is_string) {
+            iov[0].iov_base = h->text;
+            iov[0].iov_len = strlen(h->text);
+            iov[1].iov_base = "\n";
+            iov[1].iov_len = 1;
+        } else {
+            struct iovec *v = iov;
+            for (struct here_slice *slice = h->body; slice != NULL; slice = slice->next, v++) {
+                v->iov_base = slice->text;
+                v->iov_len = slice->len;
+            }
+        }
+        h->pipe->here = iov;
+        h->pipe->nhere = n;
+        h->pipe->here_literal = h->literal;
+    }
+}
 
 %}
 
+%define api.pure full
+%define api.push-pull push
+%parse-param {struct ast_parser *parser}
+
 /* LALR stack types */
 %union {
   struct cmd_helper *command;
   struct pipe_helper *pipe;
-  struct ast_pipeline *ast_pipe;
-  struct ast_command_line *cmdline;
+  struct code code;
   char *word;
+  struct here *here;
 }
 
 /* Nonterminals */
 %type <command> input output
-%type <command> command
+%type <command> command for_words
 %type <pipe> pipeline
-%type <ast_pipe> ast_pipeline
-%type <cmdline> cmd_list
+%type <code> term_list condition and_or unit compound else_part
+%type <word> word arg
+
+%code {
+static void yyerror(struct ast_parser *parser, const char *msg);
+}
 
 /* Terminals */
 %token <word> WORD
-%token GREATER_GREATER GREATER_AMPERSAND PIPE_AMPERSAND
+/* NAME=value; an assignment before the command name, else a word */
+%token <word> ASSIGNMENT
+%token GREATER_GREATER GREATER_AMPERSAND PIPE_AMPERSAND AND_AND OR_OR
+/* <<DELIM, whose body the scanner reads from the following lines, and <<< */
+%token <here> HERE_DOC
+%token LESS_LESS_LESS
+/* Reserved words; anywhere but at the start of a command they are words */
+%token <word> IF THEN ELSE ELIF FI WHILE DO DONE FOR IN
 
 %%
-cmd_line: cmd_list { cmdline_complete($1); }
-
-cmd_list:	/* Null Command */ { $$ = ast_command_line_create_empty(); }
-|		ast_pipeline { 
-            $$ = ast_command_line_create($1);
-        } 
-|		cmd_list ';'
-|		cmd_list '&' {
-            $$ = $1;
-            if (!list_empty(&$1->pipes)) {
-                struct ast_pipeline * last;
-                last = list_entry(list_back(&$1->pipes),
-                                  struct ast_pipeline, elem);
-                last->bg_job = true;
-            }
+cmd_line: term_list { parser->result = link_code(parser, $1); }
+|		term_list and_or { parser->result = link_code(parser, code_concat($1, $2)); }
+
+/* and-or lists, each ended by ; & or a newline */
+term_list:	/* Null Command */ { $$ = code_empty(); }
+|		term_list ';'
+|		term_list '\n'
+|		term_list '&'
+|		term_list and_or ';'	{ $$ = code_concat($1, $2); }
+|		term_list and_or '\n'	{ $$ = code_concat($1, $2); }
+|		term_list and_or '&'	{
+            if (!set_background(parser, $2))
+                YYABORT;
+            $$ = code_concat($1, $2);
         }
-|		cmd_list ';' ast_pipeline	{ 
+
+condition: term_list {
+            if ($1.first == NULL) { p_error(parser, INVNUL); YYABORT; }
             $$ = $1;
-            list_push_back(&$$->pipes, &$3->elem);
         }
-|		cmd_list '&' ast_pipeline	{ 
-            if (!list_empty(&$1->pipes)) {
-                struct ast_pipeline * last;
-                last = list_entry(list_back(&$1->pipes),
-                                  struct ast_pipeline, elem);
-                last->bg_job = true;
-            }
 
-            $$ = $1;
-            list_push_back(&$$->pipes, &$3->elem);
+and_or:	unit
+|		and_or AND_AND { parser->nopen++; } linebreak unit {
+            parser->nopen--;
+            $$ = code_and_or(parser, $1, AST_OP_JUMP_IF_FAILED, $5);
+        }
+|		and_or OR_OR { parser->nopen++; } linebreak unit {
+            parser->nopen--;
+            $$ = code_and_or(parser, $1, AST_OP_JUMP_IF_OK, $5);
         }
 
-ast_pipeline: pipeline {
-            struct pipe_helper * pipe = $1;
-            assert (!list_empty(&pipe->commands));
-            struct cmd_helper * first;
-            first = list_entry(list_front(&pipe->commands), struct cmd_helper, elem);
-            struct cmd_helper * last;
-            last = list_entry(list_back(&pipe->commands), struct cmd_helper, elem);
-
-            $$ = ast_pipeline_create(
-                first->iored_input,
-                last->iored_output,
-                last->append_to_output
-            );
-            for (struct list_elem * e = list_begin(&pipe->commands);
-                                    e != list_end(&pipe->commands);) {
-                struct cmd_helper * cmd = list_entry(e, struct cmd_helper, elem);
-                ast_pipeline_add_command($$, make_ast_command(cmd));
-                e = list_remove(e);
-                free(cmd);
-            }
-            free(pipe);
+linebreak: /* empty */
+|		linebreak '\n'
+
+unit:	pipeline { $$ = code_pipeline(parser, $1); }
+|		compound
+
+/* nopen counts the compound commands that were started, so that the
+ * end of a line tells whether it ended in the middle of one */
+compound: IF { parser->nopen++; } condition THEN term_list else_part FI {
+            parser->nopen--;
+            $$ = code_if(parser, $3, $5, $6);
+        }
+|		WHILE { parser->nopen++; } condition DO term_list DONE {
+            parser->nopen--;
+            $$ = code_while(parser, $3, $5);
+        }
+|		FOR { parser->nopen++; } WORD IN for_words separator linebreak DO term_list DONE {
+            /* the name is checked by check_names once it is terminated */
+            parser->nopen--;
+            $$ = code_for(parser, $3, $5, $9);
+        }
+
+/* if no branch is taken, the status is 0 */
+else_part: /* empty */ { $$ = code_op(parser, AST_OP_SET_STATUS, 0); }
+|		ELSE term_list { $$ = $2; }
+|		ELIF condition THEN term_list else_part {
+            $$ = code_if(parser, $2, $4, $5);
+        }
+
+for_words: /* empty */ {
+            $$ = init_cmd(parser, NULL, NULL, NULL, false, false);
         }
+|		for_words word {
+            $$ = $1;
+            add_word(parser, $$, $2);
+        }
+
+separator: ';'
+|		'\n'
+
+word:	arg | ASSIGNMENT
+
+arg:	WORD | IF | THEN | ELSE | ELIF | FI | WHILE | DO | DONE | FOR | IN
 
 pipeline: command {
-            $$ = init_pipe();
-            if (!add_to_pipeline($$, $1, false))
+            $$ = init_pipe(parser);
+            if (!add_to_pipeline(parser, $$, $1, false))
                 YYABORT;
 		}
 |		pipeline '|' command {
-            if (!add_to_pipeline($1, $3, false))
+            if (!add_to_pipeline(parser, $1, $3, false))
                 YYABORT;
             $$ = $1;
 		}
 |		pipeline PIPE_AMPERSAND command {
-            if (!add_to_pipeline($1, $3, true))
+            if (!add_to_pipeline(parser, $1, $3, true))
                 YYABORT;
             $$ = $1;
 		}
-|		'|' error 	   { p_error(INVNUL); YYABORT; }
-|		pipeline '|' error { p_error(INVNUL); YYABORT; }
+|		'|' error 	   { p_error(parser, INVNUL); YYABORT; }
+|		pipeline '|' error { p_error(parser, INVNUL); YYABORT; }
 
 command:   WORD { 
-            $$ = init_cmd($1, NULL, NULL, false, false);
+            $$ = init_cmd(parser, $1, NULL, NULL, false, false);
+        }
+|		ASSIGNMENT {
+            $$ = init_cmd(parser, NULL, NULL, NULL, false, false);
+            add_assignment(parser, $$, $1);
         }
 |		input   
 |		output
-|		command WORD {
+|		command arg {
+            $$ = $1;
+            add_word(parser, $$, $2);
+		}
+|		command ASSIGNMENT {
             $$ = $1;
-            obstack_ptr_grow(&$$->words, $2);
+            add_assignment(parser, $$, $2);
 		}
 |		command input {
-            obstack_free(&$2->words, NULL);
             /* Error: ambiguous redirect 'a <b <c' */
-            if ($1->iored_input)   { p_error(AMBINP); YYABORT; }
+            if ($1->iored_input || $1->here) { p_error(parser, AMBINP); YYABORT; }
             $$ = $1; 
             $$->iored_input = $2->iored_input;
-            free($2);
+            $$->here = $2->here;
 		}
 |		command output {
-            obstack_free(&$2->words, NULL);
             /* Error: ambiguous redirect 'a >b >c' */
-            if ($1->iored_output) { p_error(AMBOUT); YYABORT; }
+            if ($1->iored_output) { p_error(parser, AMBOUT); YYABORT; }
             $$ = $1; 
             $$->iored_output = $2->iored_output;
             $$->append_to_output = $2->append_to_output;
             $$->redirect_stderr = $2->redirect_stderr;
-            free($2);
 		}
 
-input:	'<' WORD { 
-            $$ = init_cmd(NULL, $2, NULL, false, false);
+input:	'<' word { 
+            $$ = init_cmd(parser, NULL, $2, NULL, false, false);
+        }
+|		HERE_DOC {
+            $$ = init_cmd(parser, NULL, NULL, NULL, false, false);
+            $$->here = $1;
         }
-|		'<' error	  { p_error(MISRED); YYABORT; }
+|		LESS_LESS_LESS word {
+            $$ = init_cmd(parser, NULL, NULL, NULL, false, false);
+            $$->here = here_string(parser, $2);
+        }
+|		'<' error	  { p_error(parser, MISRED); YYABORT; }
+|		LESS_LESS_LESS error { p_error(parser, MISRED); YYABORT; }
 
-output:	'>' WORD { 
-            $$ = init_cmd(NULL, NULL, $2, false, false);
+output:	'>' word { 
+            $$ = init_cmd(parser, NULL, NULL, $2, false, false);
         }
-|		GREATER_AMPERSAND WORD { 
-            $$ = init_cmd(NULL, NULL, $2, false, true);
+|		GREATER_AMPERSAND word { 
+            $$ = init_cmd(parser, NULL, NULL, $2, false, true);
         }
-|		GREATER_GREATER WORD { 
-            $$ = init_cmd(NULL, NULL, $2, true, false);
+|		GREATER_GREATER word { 
+            $$ = init_cmd(parser, NULL, NULL, $2, true, false);
         }
 		/* Error: missing redirect */
-|		'>' error 	  { p_error(MISRED); YYABORT; }
-|		GREATER_GREATER error { p_error(MISRED); YYABORT; }
+|		'>' error 	  { p_error(parser, MISRED); YYABORT; }
+|		GREATER_GREATER error { p_error(parser, MISRED); YYABORT; }
 
 %%
-static char * inputline;    /* currently processed input line */
-#define YY_INPUT(buf,result,max_size) \
-    { \
-        result = *inputline ? (buf[0] = *inputline++, 1) : YY_NULL; \
+/*
+ * Words are slices of the line's copy in the arena rather than copies.  A word cannot be
+ * NUL-terminated while the line is being scanned, because flex still
+ * needs the character that follows it, so the ends are recorded here
+ * and terminated once the whole line has been parsed.
+ */
+static char *
+lex_word(struct ast_parser *parser, char *word, size_t len)
+{
+    if (parser->nword_ends == parser->max_word_ends) {
+        parser->max_word_ends = parser->max_word_ends ? 2 * parser->max_word_ends : 64;
+        parser->word_ends = realloc(parser->word_ends,
+                                    parser->max_word_ends * sizeof *parser->word_ends);
     }
+    parser->word_ends[parser->nword_ends++] = word + len;
+    return word;
+}
 
-#define YY_NO_INPUT
+/* A word that was in quotes, which the scanner drops.  Such words are
+ * recorded so that they are not globbed. */
+static char *
+lex_quoted_word(struct ast_parser *parser, char *word, size_t len)
+{
+    if (parser->nquoted_words == parser->max_quoted_words) {
+        parser->max_quoted_words = parser->max_quoted_words ? 2 * parser->max_quoted_words : 16;
+        parser->quoted_words = realloc(parser->quoted_words,
+                                       parser->max_quoted_words * sizeof *parser->quoted_words);
+    }
+    parser->quoted_words[parser->nquoted_words++] = word;
+    return lex_word(parser, word, len);
+}
+
+/* the scanner's tokens are pushed to the parser by parse_line below */
+#define YY_DECL static int scan(YYSTYPE *yylval_param, yyscan_t yyscanner)
 #include "lex.yy.c"
 
 static void
-p_error(char *msg) 
+p_error(struct ast_parser *parser, char *msg) 
 { 
     /* print error */
-    fprintf(stderr, "%s\n", msg); 
+    parser->reported = true;
+    if (parser->report_errors)
+        fprintf(stderr, "%s\n", msg); 
 }
 
-extern int yyparse (void);
-
 /* do not use default error handling since errors are handled above. */
-void 
-yyerror(const char *msg) { }
+static void 
+yyerror(struct ast_parser *parser, const char *msg) { }
+
+/* Initial arena size for a line of length len.  Generous enough that
+ * typical lines need a single allocation. */
+#define ARENA_SIZE(len) (512 + 8 * (len))
+
+struct ast_parser *
+ast_parser_create(void)
+{
+    struct ast_parser *parser = calloc(1, sizeof *parser);
+    parser->pstate = yypstate_new();
+    if (parser->pstate == NULL || yylex_init_extra(parser, &parser->scanner)) {
+        yypstate_delete(parser->pstate);
+        free(parser);
+        return NULL;
+    }
+    return parser;
+}
+
+/* Drop a parse that was left incomplete, if there is one */
+static void
+discard_parse(struct ast_parser *parser)
+{
+    if (parser->arena == NULL)
+        return;
+    arena_put(parser->arena);
+    parser->arena = NULL;
+    /* the push parser is in the middle of the command; start afresh */
+    yypstate_delete(parser->pstate);
+    parser->pstate = yypstate_new();
+}
+
+void
+ast_parser_destroy(struct ast_parser *parser)
+{
+    if (parser->arena != NULL)
+        arena_put(parser->arena);
+    yypstate_delete(parser->pstate);
+    yylex_destroy(parser->scanner);
+    free(parser->word_ends);
+    free(parser->quoted_words);
+    free(parser);
+}
+
+/* Scan a line and push its tokens to the parser.  Returns the command
+ * line once the command is complete, or NULL if there was an error or
+ * the command goes on in the next line. */
+static struct ast_command_line *
+parse_line(struct ast_parser *parser, const char *line)
+{
+    /* flex scans a copy in place; it wants two NUL bytes at the end.
+     * The line ends in a newline, which ends the command unless the
+     * line stopped in the middle of one. */
+    size_t len = strlen(line);
+    char *text = arena_alloc(parser->arena, len + 3);
+    memcpy(text, line, len);
+    text[len] = '\n';
+    text[len + 1] = text[len + 2] = '\0';
+
+    YY_BUFFER_STATE buffer = yy_scan_buffer(text, len + 3, parser->scanner);
+    YYSTYPE value;
+    int token, status = YYPUSH_MORE;
+    while (status == YYPUSH_MORE && (token = scan(&value, parser->scanner)) != 0)
+        status = yypush_parse(parser->pstate, token, &value, parser);
+    yy_delete_buffer(buffer, parser->scanner);
+
+    /* an unfinished compound command or && || list, or a here-document
+     * whose delimiter line has not come yet */
+    parser->incomplete = status == YYPUSH_MORE
+                         && (parser->nopen > 0 || parser->pending_here != NULL);
+    if (parser->incomplete)
+        return NULL;
+    if (status == YYPUSH_MORE)
+        status = yypush_parse(parser->pstate, 0, NULL, parser);
+
+    struct ast_command_line *cline = parser->result;
+    int error = status != 0;
+    if (error && !parser->reported)
+        p_error(parser, SYNERR);
+    if (!error) {
+        for (size_t i = 0; i < parser->nword_ends; i++)
+            *parser->word_ends[i] = '\0';
+        link_heres(parser);
+        error = !check_names(parser, cline);
+    }
+    if (error) {
+        arena_put(parser->arena);
+        cline = NULL;
+    }
+    /* otherwise the command line keeps the parser's reference */
+    parser->arena = NULL;
+    parser->result = NULL;
+    return cline;
+}
+
+struct ast_command_line *
+ast_parser_parse(struct ast_parser *parser, const char * line, bool report_errors)
+{
+    discard_parse(parser);
+    parser->arena = arena_create(ARENA_SIZE(strlen(line)));
+    parser->nword_ends = 0;
+    parser->nquoted_words = 0;
+    parser->result = NULL;
+    parser->nloops = 0;
+    parser->nopen = 0;
+    parser->report_errors = report_errors;
+    parser->reported = false;
+    parser->heres = parser->pending_here = NULL;
+    parser->last_here = &parser->heres;
+    scan_reset(parser->scanner);
+    return parse_line(parser, line);
+}
+
+struct ast_command_line *
+ast_parser_continue(struct ast_parser *parser, const char * line)
+{
+    if (parser->arena == NULL)
+        return ast_parser_parse(parser, line, parser->report_errors);
+    return parse_line(parser, line);
+}
+
+bool
+ast_parser_incomplete(struct ast_parser *parser)
+{
+    return parser->incomplete;
+}
+
+/* Each thread that uses ast_parse_command_line gets a context of its
+ * own, which is destroyed when the thread exits. */
+static pthread_key_t thread_parser_key;
+static pthread_once_t thread_parser_once = PTHREAD_ONCE_INIT;
+
+static void
+destroy_thread_parser(void *parser)
+{
+    ast_parser_destroy(parser);
+}
+
+static void
+create_thread_parser_key(void)
+{
+    pthread_key_create(&thread_parser_key, destroy_thread_parser);
+}
 
-static struct ast_command_line * commandline;
-static void cmdline_complete(struct ast_command_line *cline)
+static struct ast_parser *
+thread_parser(void)
 {
-    commandline = cline;
+    pthread_once(&thread_parser_once, create_thread_parser_key);
+    struct ast_parser *parser = pthread_getspecific(thread_parser_key);
+    if (parser == NULL) {
+        parser = ast_parser_create();
+        if (parser == NULL) {
+            perror("ast_parser_create");
+            abort();
+        }
+        pthread_setspecific(thread_parser_key, parser);
+    }
+    return parser;
 }
 
 /* 
  * parse a commandline.
  */
 struct ast_command_line *
-ast_parse_command_line(char * line)
+ast_parse_command_line(const char * line)
+{
+    return ast_parser_parse(thread_parser(), line, true);
+}
+
+struct ast_command_line *
+ast_parse_command_line_quietly(const char * line)
 {
-    inputline = line;
-    commandline = NULL;
+    return ast_parser_parse(thread_parser(), line, false);
+}
 
-    int error = yyparse();
+struct ast_command_line *
+ast_parse_continued_line(const char * line)
+{
+    return ast_parser_continue(thread_parser(), line);
+}
 
-    return error ? NULL : commandline;
+bool
+ast_parse_incomplete(void)
+{
+    return thread_parser()->incomplete;
 }
@@ -45,6 +45,9 @@ termstate_init(void)
 void 
 termstate_save(struct termios *saved_tty_state)
 {
+    if (terminal_fd == -1)
+        return;
+
     int rc = tcgetattr(terminal_fd, saved_tty_state);
     if (rc == -1)
         utils_fatal_error("tcgetattr failed: ");
@@ -90,6 +93,9 @@ termstate_get_tty_fd(void)
 void
 termstate_give_terminal_to(struct termios *pg_tty_state, pid_t pgrp)
 {
+    if (terminal_fd == -1)
+        return;
+
     signal_block(SIGTTOU);
     int rc = tcsetpgrp(termstate_get_tty_fd(), pgrp);
     if (rc == -1)
@@ -103,6 +109,9 @@ termstate_give_terminal_to(struct termios *pg_tty_state, pid_t pgrp)
 void 
 termstate_give_terminal_back_to_shell(void)
 {
+    if (terminal_fd == -1)
+        return;
+
     assert (shell_pgrp > 0 || !!!"termstate_init was not called");
     termstate_give_terminal_to(&saved_tty_state, shell_pgrp);
 }
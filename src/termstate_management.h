@@ -3,7 +3,11 @@
 
 #include <sys/types.h>
 
-/* Initialize tty support. */
+/* Initialize tty support.
+ * A shell that runs without job control (a script, or -c) does not call
+ * this; the functions that save, restore and hand over the terminal
+ * then do nothing.
+ */
 void termstate_init(void);
 
 /* Save current terminal settings.
@@ -0,0 +1,645 @@
+/*
+ * echo, printf, true, false and test as builtins.
+ *
+ * These are the commands short scripts spend most of their time
+ * spawning.  Running them in the shell saves a clone and an exec each;
+ * in a pipeline they still run in a forked copy of the shell.
+ */
+#define _GNU_SOURCE 1
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "utility_builtins.h"
+
+/* Value returned by read_escape for \c, which ends all output */
+#define ESCAPE_STOP (-1)
+
+/* Interpret the escape sequence following a backslash at *sp and advance
+ * *sp past it.  Octal escapes are \0nnn in echo and %b arguments
+ * (zero_octal) and \nnn in printf formats.  Sequences that are not
+ * escapes yield the backslash itself, leaving *sp at the next character. */
+static int
+read_escape(const char **sp, bool zero_octal)
+{
+    const char *s = *sp;
+    int c = (unsigned char)*s++;
+    int n;
+
+    switch (c)
+    {
+    case 'a': c = '\a'; break;
+    case 'b': c = '\b'; break;
+    case 'e': c = 033; break;
+    case 'f': c = '\f'; break;
+    case 'n': c = '\n'; break;
+    case 'r': c = '\r'; break;
+    case 't': c = '\t'; break;
+    case 'v': c = '\v'; break;
+    case '\\': break;
+    case 'c':
+        *sp = s;
+        return ESCAPE_STOP;
+    case 'x':
+        if (!isxdigit((unsigned char)*s))
+            return '\\';
+        c = 0;
+        for (n = 0; n < 2 && isxdigit((unsigned char)*s); n++, s++)
+            c = c * 16 + (isdigit((unsigned char)*s) ? *s - '0' : tolower((unsigned char)*s) - 'a' + 10);
+        break;
+    case '0': case '1': case '2': case '3':
+    case '4': case '5': case '6': case '7':
+        if (zero_octal)
+        {
+            if (c != '0')
+                return '\\';
+            c = 0;
+            n = 0;
+        }
+        else
+        {
+            c -= '0';
+            n = 1;
+        }
+        for (; n < 3 && *s >= '0' && *s <= '7'; n++, s++)
+            c = c * 8 + (*s - '0');
+        c &= 0xff;
+        break;
+    default:
+        return '\\';
+    }
+    *sp = s;
+    return c;
+}
+
+/* Write s with escapes interpreted.  Returns false if \c was seen. */
+static bool
+put_escaped(const char *s, FILE *out)
+{
+    while (*s)
+    {
+        int c = (unsigned char)*s++;
+        if (c == '\\')
+        {
+            c = read_escape(&s, true);
+            if (c == ESCAPE_STOP)
+                return false;
+        }
+        putc(c, out);
+    }
+    return true;
+}
+
+int
+utility_echo(char *const *argv)
+{
+    bool newline = true;
+    bool escapes = false;
+
+    /* Options must come first, and only words made of n, e and E count */
+    for (argv++; *argv && (*argv)[0] == '-' && (*argv)[1]; argv++)
+    {
+        if ((*argv)[strspn(*argv + 1, "neE") + 1] != '\0')
+            break;
+        for (const char *o = *argv + 1; *o; o++)
+        {
+            if (*o == 'n')
+                newline = false;
+            else
+                escapes = *o == 'e';
+        }
+    }
+
+    for (; *argv; argv++)
+    {
+        if (escapes)
+        {
+            if (!put_escaped(*argv, stdout))
+                return 0;
+        }
+        else
+            fputs(*argv, stdout);
+        if (argv[1])
+            putchar(' ');
+    }
+    if (newline)
+        putchar('\n');
+    return 0;
+}
+
+int
+utility_true(char *const *argv)
+{
+    return 0;
+}
+
+int
+utility_false(char *const *argv)
+{
+    return 1;
+}
+
+/* Numeric arguments for printf.  A leading quote yields the value of the
+ * following character; anything else must be a C integer constant (or
+ * floating constant).  Bad input is reported and sets *rc. */
+static bool
+check_number(const char *arg, const char *end, int *rc)
+{
+    if (end == arg || *end != '\0')
+    {
+        fprintf(stderr, "printf: %s: invalid number\n", arg);
+        *rc = 1;
+        return false;
+    }
+    if (errno == ERANGE)
+    {
+        fprintf(stderr, "printf: %s: %s\n", arg, strerror(ERANGE));
+        *rc = 1;
+        return false;
+    }
+    return true;
+}
+
+static intmax_t
+get_intmax(const char *arg, int *rc)
+{
+    if (arg == NULL)
+        return 0;
+    if (*arg == '\'' || *arg == '"')
+        return (unsigned char)arg[1];
+
+    char *end;
+    errno = 0;
+    intmax_t v = strtoimax(arg, &end, 0);
+    check_number(arg, end, rc);
+    return v;
+}
+
+static uintmax_t
+get_uintmax(const char *arg, int *rc)
+{
+    if (arg == NULL)
+        return 0;
+    if (*arg == '\'' || *arg == '"')
+        return (unsigned char)arg[1];
+
+    char *end;
+    errno = 0;
+    /* Negative values wrap around, as in C */
+    uintmax_t v = strchr(arg, '-') ? (uintmax_t)strtoimax(arg, &end, 0) : strtoumax(arg, &end, 0);
+    check_number(arg, end, rc);
+    return v;
+}
+
+static long double
+get_double(const char *arg, int *rc)
+{
+    if (arg == NULL)
+        return 0;
+    if (*arg == '\'' || *arg == '"')
+        return (unsigned char)arg[1];
+
+    char *end;
+    errno = 0;
+    long double v = strtold(arg, &end);
+    check_number(arg, end, rc);
+    return v;
+}
+
+/* Print one pass over the printf format, consuming arguments from *argsp.
+ * Returns false if output must stop (\c, or an invalid conversion). */
+static bool
+print_format(const char *fmt, char *const **argsp, int *rc)
+{
+    char *const *args = *argsp;
+    bool keep_going = true;
+
+    for (const char *f = fmt; *f && keep_going; )
+    {
+        if (*f == '\\')
+        {
+            f++;
+            int c = read_escape(&f, false);
+            if (c == ESCAPE_STOP)
+            {
+                keep_going = false;
+                break;
+            }
+            putchar(c);
+            continue;
+        }
+        if (*f != '%')
+        {
+            putchar(*f++);
+            continue;
+        }
+        if (f[1] == '%')
+        {
+            putchar('%');
+            f += 2;
+            continue;
+        }
+
+        /* Rebuild the conversion as %<flags>*.*<length><conv> */
+        const char *start = f++;
+        char spec[16] = "%";
+        size_t nflags = strspn(f, "-+ #0");
+        if (nflags > 5)
+            nflags = 5;
+        strncat(spec, f, nflags);
+        f += nflags;
+
+        int width = 0, prec = -1;
+        if (*f == '*')
+        {
+            f++;
+            width = (int)get_intmax(*args, rc);
+            if (*args)
+                args++;
+        }
+        else
+            while (isdigit((unsigned char)*f))
+                width = width * 10 + (*f++ - '0');
+        if (*f == '.')
+        {
+            f++;
+            prec = 0;
+            if (*f == '*')
+            {
+                f++;
+                prec = (int)get_intmax(*args, rc);
+                if (*args)
+                    args++;
+            }
+            else
+                while (isdigit((unsigned char)*f))
+                    prec = prec * 10 + (*f++ - '0');
+        }
+
+        char conv = *f;
+        if (conv == '\0' || !strchr("diouxXeEfFgGaAcsb", conv))
+        {
+            fprintf(stderr, "printf: %.*s: invalid conversion specification\n",
+                    (int)(f - start + (conv != '\0')), start);
+            *rc = 1;
+            return false;
+        }
+        f++;
+
+        const char *arg = *args;
+        if (*args)
+            args++;
+
+        size_t len = strlen(spec);
+        switch (conv)
+        {
+        case 'd': case 'i':
+            strcpy(spec + len, "*.*j");
+            spec[len + 4] = conv;
+            spec[len + 5] = '\0';
+            printf(spec, width, prec, get_intmax(arg, rc));
+            break;
+        case 'o': case 'u': case 'x': case 'X':
+            strcpy(spec + len, "*.*j");
+            spec[len + 4] = conv;
+            spec[len + 5] = '\0';
+            printf(spec, width, prec, get_uintmax(arg, rc));
+            break;
+        case 'e': case 'E': case 'f': case 'F':
+        case 'g': case 'G': case 'a': case 'A':
+            strcpy(spec + len, "*.*L");
+            spec[len + 4] = conv;
+            spec[len + 5] = '\0';
+            printf(spec, width, prec, get_double(arg, rc));
+            break;
+        case 'c':
+            strcpy(spec + len, "*c");
+            if (arg && *arg)
+                printf(spec, width, *arg);
+            break;
+        case 's':
+            strcpy(spec + len, "*.*s");
+            printf(spec, width, prec, arg ? arg : "");
+            break;
+        case 'b':
+        {
+            /* Expand into a buffer so width and precision still apply */
+            char *buf;
+            size_t buflen;
+            FILE *mem = open_memstream(&buf, &buflen);
+            keep_going = put_escaped(arg ? arg : "", mem);
+            fclose(mem);
+            strcpy(spec + len, "*.*s");
+            printf(spec, width, prec, buf);
+            free(buf);
+            break;
+        }
+        }
+    }
+
+    *argsp = args;
+    return keep_going;
+}
+
+int
+utility_printf(char *const *argv)
+{
+    if (argv[1] == NULL)
+    {
+        fprintf(stderr, "printf: usage: printf format [arguments]\n");
+        return 2;
+    }
+
+    /* The format is reused until all arguments are consumed */
+    int rc = 0;
+    const char *fmt = argv[1];
+    char *const *args = argv + 2;
+    for (;;)
+    {
+        char *const *before = args;
+        if (!print_format(fmt, &args, &rc))
+            break;
+        if (*args == NULL || args == before)
+            break;
+    }
+    return rc;
+}
+
+/*
+ * test and [
+ *
+ * With up to four arguments the POSIX rules decide how the arguments
+ * are grouped; with more, a recursive descent parser handles !, -a, -o
+ * and parentheses, -a binding tighter than -o.
+ */
+struct test_state
+{
+    char *const *args;  /* next argument */
+    char *const *end;   /* end of the arguments */
+    bool error;         /* syntax error seen, exit status 2 */
+};
+
+static void
+test_syntax_error(struct test_state *t, const char *what, const char *arg)
+{
+    if (!t->error)
+    {
+        if (arg)
+            fprintf(stderr, "test: %s: %s\n", arg, what);
+        else
+            fprintf(stderr, "test: %s\n", what);
+    }
+    t->error = true;
+}
+
+static bool
+is_unary_op(const char *s)
+{
+    return s[0] == '-' && s[1] && s[2] == '\0' && strchr("bcdefghkLnprsStuwxz", s[1]);
+}
+
+static bool
+is_binary_op(const char *s)
+{
+    static const char *const ops[] = {
+        "=", "==", "!=", "<", ">", "-eq", "-ne", "-lt", "-le", "-gt", "-ge",
+        "-nt", "-ot", "-ef", NULL
+    };
+    for (const char *const *op = ops; *op; op++)
+        if (strcmp(s, *op) == 0)
+            return true;
+    return false;
+}
+
+static intmax_t
+test_integer(struct test_state *t, const char *s)
+{
+    char *end;
+    errno = 0;
+    intmax_t v = strtoimax(s, &end, 10);
+    while (isspace((unsigned char)*end))
+        end++;
+    if (end == s || *end != '\0' || errno == ERANGE)
+        test_syntax_error(t, "integer expression expected", s);
+    return v;
+}
+
+static bool
+test_unary(struct test_state *t, const char *op, const char *arg)
+{
+    struct stat st;
+
+    switch (op[1])
+    {
+    case 'n': return *arg != '\0';
+    case 'z': return *arg == '\0';
+    case 't': return isatty((int)test_integer(t, arg));
+    case 'r': return faccessat(AT_FDCWD, arg, R_OK, AT_EACCESS) == 0;
+    case 'w': return faccessat(AT_FDCWD, arg, W_OK, AT_EACCESS) == 0;
+    case 'x': return faccessat(AT_FDCWD, arg, X_OK, AT_EACCESS) == 0;
+    case 'h':
+    case 'L': return lstat(arg, &st) == 0 && S_ISLNK(st.st_mode);
+    }
+
+    if (stat(arg, &st) != 0)
+        return false;
+    switch (op[1])
+    {
+    case 'b': return S_ISBLK(st.st_mode);
+    case 'c': return S_ISCHR(st.st_mode);
+    case 'd': return S_ISDIR(st.st_mode);
+    case 'e': return true;
+    case 'f': return S_ISREG(st.st_mode);
+    case 'g': return (st.st_mode & S_ISGID) != 0;
+    case 'k': return (st.st_mode & S_ISVTX) != 0;
+    case 'p': return S_ISFIFO(st.st_mode);
+    case 's': return st.st_size > 0;
+    case 'S': return S_ISSOCK(st.st_mode);
+    case 'u': return (st.st_mode & S_ISUID) != 0;
+    }
+    return false;
+}
+
+static bool
+test_binary(struct test_state *t, const char *a, const char *op, const char *b)
+{
+    if (strcmp(op, "=") == 0 || strcmp(op, "==") == 0)
+        return strcmp(a, b) == 0;
+    if (strcmp(op, "!=") == 0)
+        return strcmp(a, b) != 0;
+    if (strcmp(op, "<") == 0)
+        return strcoll(a, b) < 0;
+    if (strcmp(op, ">") == 0)
+        return strcoll(a, b) > 0;
+
+    if (op[1] == 'n' || op[1] == 'o' || strcmp(op, "-ef") == 0)
+    {
+        struct stat sa, sb;
+        bool ha = stat(a, &sa) == 0, hb = stat(b, &sb) == 0;
+        if (strcmp(op, "-ef") == 0)
+            return ha && hb && sa.st_dev == sb.st_dev && sa.st_ino == sb.st_ino;
+        if (strcmp(op, "-nt") == 0)
+            return ha && (!hb || sa.st_mtim.tv_sec > sb.st_mtim.tv_sec ||
+                          (sa.st_mtim.tv_sec == sb.st_mtim.tv_sec && sa.st_mtim.tv_nsec > sb.st_mtim.tv_nsec));
+        return hb && (!ha || sa.st_mtim.tv_sec < sb.st_mtim.tv_sec ||
+                      (sa.st_mtim.tv_sec == sb.st_mtim.tv_sec && sa.st_mtim.tv_nsec < sb.st_mtim.tv_nsec));
+    }
+
+    intmax_t x = test_integer(t, a), y = test_integer(t, b);
+    if (strcmp(op, "-eq") == 0) return x == y;
+    if (strcmp(op, "-ne") == 0) return x != y;
+    if (strcmp(op, "-lt") == 0) return x < y;
+    if (strcmp(op, "-le") == 0) return x <= y;
+    if (strcmp(op, "-gt") == 0) return x > y;
+    return x >= y;
+}
+
+static bool test_or(struct test_state *t);
+
+static size_t
+test_remaining(struct test_state *t)
+{
+    return t->end - t->args;
+}
+
+static bool
+test_primary(struct test_state *t)
+{
+    if (test_remaining(t) == 0)
+    {
+        test_syntax_error(t, "argument expected", NULL);
+        return false;
+    }
+
+    char *const *a = t->args;
+    if (strcmp(a[0], "(") == 0 && test_remaining(t) > 1)
+    {
+        t->args++;
+        bool v = test_or(t);
+        if (test_remaining(t) == 0 || strcmp(t->args[0], ")") != 0)
+        {
+            test_syntax_error(t, "')' expected", NULL);
+            return false;
+        }
+        t->args++;
+        return v;
+    }
+    if (test_remaining(t) >= 3 && is_binary_op(a[1]))
+    {
+        t->args += 3;
+        return test_binary(t, a[0], a[1], a[2]);
+    }
+    if (is_unary_op(a[0]) && test_remaining(t) >= 2)
+    {
+        t->args += 2;
+        return test_unary(t, a[0], a[1]);
+    }
+    t->args++;
+    return a[0][0] != '\0';
+}
+
+static bool
+test_not(struct test_state *t)
+{
+    if (test_remaining(t) > 1 && strcmp(t->args[0], "!") == 0)
+    {
+        t->args++;
+        return !test_not(t);
+    }
+    return test_primary(t);
+}
+
+static bool
+test_and(struct test_state *t)
+{
+    bool v = test_not(t);
+    while (test_remaining(t) > 0 && strcmp(t->args[0], "-a") == 0)
+    {
+        t->args++;
+        v = test_not(t) && v;
+    }
+    return v;
+}
+
+static bool
+test_or(struct test_state *t)
+{
+    bool v = test_and(t);
+    while (test_remaining(t) > 0 && strcmp(t->args[0], "-o") == 0)
+    {
+        t->args++;
+        v = test_and(t) || v;
+    }
+    return v;
+}
+
+/* Evaluate the n arguments at a, using the POSIX rules for n <= 4 */
+static bool
+test_eval(struct test_state *t, char *const *a, size_t n)
+{
+    switch (n)
+    {
+    case 0:
+        return false;
+    case 1:
+        return a[0][0] != '\0';
+    case 2:
+        if (strcmp(a[0], "!") == 0)
+            return !test_eval(t, a + 1, 1);
+        if (is_unary_op(a[0]))
+            return test_unary(t, a[0], a[1]);
+        test_syntax_error(t, "unary operator expected", a[0]);
+        return false;
+    case 3:
+        if (is_binary_op(a[1]))
+            return test_binary(t, a[0], a[1], a[2]);
+        if (strcmp(a[0], "!") == 0)
+            return !test_eval(t, a + 1, 2);
+        if (strcmp(a[0], "(") == 0 && strcmp(a[2], ")") == 0)
+            return test_eval(t, a + 1, 1);
+        break;
+    case 4:
+        if (strcmp(a[0], "!") == 0)
+            return !test_eval(t, a + 1, 3);
+        if (strcmp(a[0], "(") == 0 && strcmp(a[3], ")") == 0)
+            return test_eval(t, a + 1, 2);
+        break;
+    }
+
+    t->args = a;
+    t->end = a + n;
+    bool v = test_or(t);
+    if (test_remaining(t) > 0)
+        test_syntax_error(t, "too many arguments", NULL);
+    return v;
+}
+
+int
+utility_test(char *const *argv)
+{
+    size_t argc = 0;
+    while (argv[argc])
+        argc++;
+
+    if (strcmp(argv[0], "[") == 0)
+    {
+        if (strcmp(argv[argc - 1], "]") != 0)
+        {
+            fprintf(stderr, "[: missing ']'\n");
+            return 2;
+        }
+        argc--;
+    }
+
+    struct test_state t = { .error = false };
+    bool v = test_eval(&t, argv + 1, argc - 1);
+    return t.error ? 2 : !v;
+}
@@ -0,0 +1,20 @@
+#ifndef __UTILITY_BUILTINS_H
+#define __UTILITY_BUILTINS_H
+
+/*
+ * In-process versions of small utilities that scripts run constantly:
+ * echo, printf, true, false and test (also called as '[').
+ *
+ * Each takes a NULL terminated argv, with the command name in argv[0],
+ * writes to stdout/stderr through stdio and returns the exit status the
+ * external program would have.  Output follows POSIX; echo also accepts
+ * the -n, -e and -E options, and printf and echo -e understand \xHH.
+ */
+
+int utility_echo(char *const *argv);
+int utility_printf(char *const *argv);
+int utility_true(char *const *argv);
+int utility_false(char *const *argv);
+int utility_test(char *const *argv);
+
+#endif /* __UTILITY_BUILTINS_H */
@@ -0,0 +1,60 @@
+#!/usr/bin/python
+#
+# utility_builtins_test: tests the echo, printf, true, false and test builtins
+#
+# Test the output of the builtins, alone, in pipelines and redirected
+#
+
+import sys, imp, atexit, os, pexpect, proc_check, signal, time, threading
+from testutils import *
+
+console = setup_tests()
+
+# ensure that shell prints expected prompt
+expect_prompt()
+
+outfile = "/tmp/cush_utility_%d.txt" % os.getpid()
+atexit.register(lambda: os.path.exists(outfile) and os.unlink(outfile))
+
+# echo and its options
+sendline("echo hello   world")
+expect_exact("hello world", "echo did not join its arguments")
+
+sendline('echo -e "a\\tb"')
+expect_exact("a\tb", "echo -e did not expand escapes")
+
+# printf reuses its format for extra arguments
+sendline('printf "%05d|%-3s|\\n" 42 ab 7 c')
+expect_exact("00042|ab |", "printf did not format the first line")
+expect_exact("00007|c  |", "printf did not reuse its format")
+
+sendline('printf "%x %o %.2f\\n" 255 8 3.14159')
+expect_exact("ff 10 3.14", "printf did not convert numbers")
+
+# builtins in pipelines and with redirection
+sendline("echo builtin into pipe | rev")
+expect_exact("epip otni nitliub", "echo did not write into the pipe")
+
+sendline('printf "%s\\n" redirected > ' + outfile)
+expect_prompt()
+sendline("cat " + outfile)
+expect_exact("redirected", "printf did not write to the output file")
+
+# true, false and test produce no output
+sendline("true")
+expect_prompt()
+sendline("false")
+expect_prompt()
+sendline("test -d /")
+expect_prompt()
+sendline("[ a = a ]")
+expect_prompt()
+
+sendline("[ a = a")
+expect_exact("[: missing ']'", "expected an error for a missing ]")
+
+#exit
+sendline("exit")
+expect_exact("exit\r\n", "Shell output extraneous characters")
+
+test_success()
@@ -0,0 +1,501 @@
+/*
+ * Shell variables and the environment built from them.
+ *
+ * Two chained hash tables: one of interned strings, each with a count
+ * of the variables that use it, and one of the variables themselves,
+ * keyed by name.  Assigning a value that some variable already has, or
+ * had a moment ago in a loop, finds the existing string and allocates
+ * nothing.
+ */
+#define _GNU_SOURCE 1
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <ctype.h>
+#include <unistd.h>
+
+#include "variables.h"
+
+struct interned
+{
+    struct interned *next;  /* Next string in the same bucket */
+    uint32_t hash;
+    size_t refs;            /* Variables holding this string */
+    char text[];
+};
+
+struct variable
+{
+    struct variable *next;  /* Next variable in the same bucket */
+    uint32_t hash;          /* Hash of the name */
+    char *name;             /* Interned */
+    size_t namelen;
+    char *entry;            /* Interned NAME=value, or NULL if not set */
+    bool exported;
+    size_t env_index;       /* Slot in 'env', if exported and set */
+};
+
+#define INITIAL_BUCKETS 64
+
+/* Both tables double their bucket arrays beyond a load factor of 3/4 */
+static struct interned **strings;
+static size_t nstring_buckets, nstrings;
+
+static struct variable **vars;
+static size_t nvar_buckets, nvars;
+
+/* The environment vector, rebuilt when 'env_stale' is set */
+static char **env;
+static size_t envc, env_cap;
+static bool env_stale = true;
+
+/* FNV-1a */
+static uint32_t
+hash_bytes(const char *s, size_t len)
+{
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++)
+    {
+        h ^= (unsigned char)s[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+/* ---- interned strings ---- */
+
+static void
+grow_strings(void)
+{
+    if (strings != NULL && nstrings * 4 < nstring_buckets * 3)
+        return;
+
+    size_t newsize = strings ? nstring_buckets * 2 : INITIAL_BUCKETS;
+    struct interned **newbuckets = calloc(newsize, sizeof *newbuckets);
+    for (size_t i = 0; i < nstring_buckets; i++)
+    {
+        for (struct interned *s = strings[i], *next; s; s = next)
+        {
+            next = s->next;
+            struct interned **b = &newbuckets[s->hash & (newsize - 1)];
+            s->next = *b;
+            *b = s;
+        }
+    }
+    free(strings);
+    strings = newbuckets;
+    nstring_buckets = newsize;
+}
+
+/* Return the interned copy of the 'len' bytes at 'text', with one more
+ * reference */
+static char *
+intern(const char *text, size_t len)
+{
+    grow_strings();
+    uint32_t h = hash_bytes(text, len);
+    struct interned **b = &strings[h & (nstring_buckets - 1)];
+    for (struct interned *s = *b; s; s = s->next)
+    {
+        if (s->hash == h && strncmp(s->text, text, len) == 0 && s->text[len] == '\0')
+        {
+            s->refs++;
+            return s->text;
+        }
+    }
+
+    struct interned *s = malloc(sizeof *s + len + 1);
+    s->hash = h;
+    s->refs = 1;
+    memcpy(s->text, text, len);
+    s->text[len] = '\0';
+    s->next = *b;
+    *b = s;
+    nstrings++;
+    return s->text;
+}
+
+/* Drop a reference to an interned string */
+static void
+release(char *text)
+{
+    if (text == NULL)
+        return;
+
+    struct interned *s = (struct interned *)(text - offsetof(struct interned, text));
+    if (--s->refs > 0)
+        return;
+
+    struct interned **pe = &strings[s->hash & (nstring_buckets - 1)];
+    while (*pe != s)
+        pe = &(*pe)->next;
+    *pe = s->next;
+    free(s);
+    nstrings--;
+}
+
+/* ---- variables ---- */
+
+static struct variable **
+find_var(const char *name, size_t len, uint32_t h)
+{
+    if (vars == NULL)
+        return NULL;
+
+    struct variable **pv = &vars[h & (nvar_buckets - 1)];
+    while (*pv && !((*pv)->namelen == len && memcmp((*pv)->name, name, len) == 0))
+        pv = &(*pv)->next;
+    return pv;
+}
+
+static void
+grow_vars(void)
+{
+    if (vars != NULL && nvars * 4 < nvar_buckets * 3)
+        return;
+
+    size_t newsize = vars ? nvar_buckets * 2 : INITIAL_BUCKETS;
+    struct variable **newbuckets = calloc(newsize, sizeof *newbuckets);
+    for (size_t i = 0; i < nvar_buckets; i++)
+    {
+        for (struct variable *v = vars[i], *next; v; v = next)
+        {
+            next = v->next;
+            struct variable **b = &newbuckets[v->hash & (newsize - 1)];
+            v->next = *b;
+            *b = v;
+        }
+    }
+    free(vars);
+    vars = newbuckets;
+    nvar_buckets = newsize;
+}
+
+/* Return the variable called 'name', creating it unset if needed */
+static struct variable *
+get_var(const char *name, size_t len)
+{
+    uint32_t h = hash_bytes(name, len);
+    struct variable **pv = find_var(name, len, h);
+    if (pv && *pv)
+        return *pv;
+
+    grow_vars();
+    struct variable *v = calloc(1, sizeof *v);
+    struct variable **b = &vars[h & (nvar_buckets - 1)];
+    v->hash = h;
+    v->name = intern(name, len);
+    v->namelen = len;
+    v->next = *b;
+    *b = v;
+    nvars++;
+    return v;
+}
+
+/* Give variable v the interned entry 'entry', taking over its reference */
+static void
+set_entry(struct variable *v, char *entry)
+{
+    if (v->entry == entry)
+    {
+        release(entry);
+        return;
+    }
+    if (v->exported)
+        env_stale = true;
+    release(v->entry);
+    v->entry = entry;
+}
+
+void
+variables_init(char **envp)
+{
+    for (char **e = envp; *e; e++)
+    {
+        char *eq = strchr(*e, '=');
+        if (eq == NULL)
+            continue;
+        struct variable *v = get_var(*e, eq - *e);
+        set_entry(v, intern(*e, strlen(*e)));
+        v->exported = true;
+    }
+    env_stale = true;
+}
+
+const char *
+variables_lookup(const char *name, size_t len)
+{
+    struct variable **pv = find_var(name, len, hash_bytes(name, len));
+    if (pv == NULL || *pv == NULL || (*pv)->entry == NULL)
+        return NULL;
+    return (*pv)->entry + len + 1;
+}
+
+const char *
+variables_get(const char *name)
+{
+    return variables_lookup(name, strlen(name));
+}
+
+bool
+variables_is_name(const char *name, size_t len)
+{
+    if (len == 0 || !(isalpha((unsigned char)name[0]) || name[0] == '_'))
+        return false;
+    for (size_t i = 1; i < len; i++)
+        if (!(isalnum((unsigned char)name[i]) || name[i] == '_'))
+            return false;
+    return true;
+}
+
+void
+variables_assign(const char *assignment)
+{
+    const char *eq = strchr(assignment, '=');
+    struct variable *v = get_var(assignment, eq - assignment);
+    set_entry(v, intern(assignment, strlen(assignment)));
+}
+
+void
+variables_set(const char *name, const char *value)
+{
+    /* build NAME=value in a buffer kept for the next call */
+    static char *buf;
+    static size_t buf_cap;
+    size_t namelen = strlen(name), valuelen = strlen(value);
+    if (namelen + valuelen + 2 > buf_cap)
+    {
+        buf_cap = 2 * (namelen + valuelen + 2);
+        buf = realloc(buf, buf_cap);
+    }
+    memcpy(buf, name, namelen);
+    buf[namelen] = '=';
+    memcpy(buf + namelen + 1, value, valuelen + 1);
+
+    struct variable *v = get_var(name, namelen);
+    set_entry(v, intern(buf, namelen + valuelen + 1));
+}
+
+bool
+variables_export(const char *word)
+{
+    const char *eq = strchrnul(word, '=');
+    if (!variables_is_name(word, eq - word))
+        return false;
+
+    struct variable *v = get_var(word, eq - word);
+    if (*eq == '=')
+        set_entry(v, intern(word, strlen(word)));
+    if (!v->exported && v->entry != NULL)
+        env_stale = true;
+    v->exported = true;
+    return true;
+}
+
+void
+variables_unset(const char *name)
+{
+    size_t len = strlen(name);
+    struct variable **pv = find_var(name, len, hash_bytes(name, len));
+    if (pv == NULL || *pv == NULL)
+        return;
+
+    struct variable *v = *pv;
+    if (v->exported && v->entry != NULL)
+        env_stale = true;
+    *pv = v->next;
+    release(v->name);
+    release(v->entry);
+    free(v);
+    nvars--;
+}
+
+static int
+compare_vars(const void *a, const void *b)
+{
+    return strcmp((*(struct variable *const *)a)->name, (*(struct variable *const *)b)->name);
+}
+
+void
+variables_print_exported(void)
+{
+    struct variable **sorted = malloc((nvars + 1) * sizeof *sorted);
+    size_t n = 0;
+    for (size_t i = 0; i < nvar_buckets; i++)
+        for (struct variable *v = vars[i]; v; v = v->next)
+            if (v->exported)
+                sorted[n++] = v;
+    qsort(sorted, n, sizeof *sorted, compare_vars);
+
+    for (size_t i = 0; i < n; i++)
+    {
+        if (sorted[i]->entry == NULL)
+            printf("export %s\n", sorted[i]->name);
+        else
+            printf("export %s=\"%s\"\n", sorted[i]->name, sorted[i]->entry + sorted[i]->namelen + 1);
+    }
+    free(sorted);
+}
+
+/* ---- the environment ---- */
+
+char **
+variables_environ(void)
+{
+    if (!env_stale)
+        return env;
+
+    envc = 0;
+    for (size_t i = 0; i < nvar_buckets; i++)
+    {
+        for (struct variable *v = vars[i]; v; v = v->next)
+        {
+            if (!v->exported || v->entry == NULL)
+                continue;
+            if (envc + 1 >= env_cap)
+            {
+                env_cap = env_cap ? 2 * env_cap : 64;
+                env = realloc(env, env_cap * sizeof *env);
+            }
+            v->env_index = envc;
+            env[envc++] = v->entry;
+        }
+    }
+    if (env == NULL)
+    {
+        env_cap = 1;
+        env = malloc(sizeof *env);
+    }
+    env[envc] = NULL;
+    env_stale = false;
+    return env;
+}
+
+char **
+variables_environ_with(char *const *assignments)
+{
+    char **base = variables_environ();
+    size_t nassignments = 0;
+    while (assignments[nassignments])
+        nassignments++;
+
+    char **layered = malloc((envc + nassignments + 1) * sizeof *layered);
+    memcpy(layered, base, envc * sizeof *layered);
+    size_t n = envc;
+    for (char *const *a = assignments; *a; a++)
+    {
+        /* replace the variable's slot, else one added by an earlier
+         * assignment to the same name, else add a slot */
+        size_t namelen = strchr(*a, '=') - *a;
+        struct variable **pv = find_var(*a, namelen, hash_bytes(*a, namelen));
+        size_t slot;
+        if (pv && *pv && (*pv)->exported && (*pv)->entry != NULL)
+            slot = (*pv)->env_index;
+        else
+        {
+            for (slot = envc; slot < n; slot++)
+                if (strncmp(layered[slot], *a, namelen + 1) == 0)
+                    break;
+            if (slot == n)
+                n++;
+        }
+        layered[slot] = *a;
+    }
+    layered[n] = NULL;
+    return layered;
+}
+
+/* ---- expansion ---- */
+
+/* Length of the name at 's', 0 if there is none */
+static size_t
+name_length(const char *s)
+{
+    size_t len = 0;
+    if (!(isalpha((unsigned char)s[0]) || s[0] == '_'))
+        return 0;
+    while (isalnum((unsigned char)s[len]) || s[len] == '_')
+        len++;
+    return len;
+}
+
+/* Expand 'word' into 'out', or only measure the result if 'out' is NULL.
+ * 'status' and 'pid' are the texts of $? and $$. */
+static size_t
+expand_word(char *out, const char *word, const char *status, const char *pid)
+{
+    size_t n = 0;
+#define PUT(s, len) do { if (out) memcpy(out + n, (s), (len)); n += (len); } while (0)
+
+    for (const char *p = word; *p; )
+    {
+        const char *dollar = strchrnul(p, '$');
+        PUT(p, dollar - p);
+        if (*dollar == '\0')
+            break;
+
+        const char *name = dollar + 1, *value = NULL;
+        size_t len = 0, skip = 0;
+        if (*name == '?')
+        {
+            value = status;
+            skip = 1;
+        }
+        else if (*name == '$')
+        {
+            value = pid;
+            skip = 1;
+        }
+        else if (*name == '{')
+        {
+            len = name_length(name + 1);
+            if (len > 0 && name[len + 1] == '}')
+            {
+                value = variables_lookup(name + 1, len);
+                skip = len + 2;
+                if (value == NULL)
+                    value = "";
+            }
+        }
+        else if ((len = name_length(name)) > 0)
+        {
+            value = variables_lookup(name, len);
+            skip = len;
+            if (value == NULL)
+                value = "";
+        }
+
+        if (skip == 0)
+        {
+            /* not an expansion; the '$' stands for itself */
+            PUT("$", 1);
+            p = dollar + 1;
+            continue;
+        }
+        PUT(value, strlen(value));
+        p = name + skip;
+    }
+    if (out)
+        out[n] = '\0';
+    return n;
+#undef PUT
+}
+
+char *
+variables_expand(struct arena *arena, char *word, int status)
+{
+    if (strchr(word, '$') == NULL)
+        return word;
+
+    static char pid[16];
+    if (pid[0] == '\0')
+        snprintf(pid, sizeof pid, "%ld", (long)getpid());
+    char status_text[16];
+    snprintf(status_text, sizeof status_text, "%d", status);
+
+    char *expanded = arena_alloc(arena, expand_word(NULL, word, status_text, pid) + 1);
+    expand_word(expanded, word, status_text, pid);
+    return expanded;
+}
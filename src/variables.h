@@ -0,0 +1,66 @@
+#ifndef __VARIABLES_H
+#define __VARIABLES_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "arena.h"
+
+/*
+ * Shell variables.
+ *
+ * A variable is its name and one "NAME=value" string, both interned:
+ * every variable and every environment vector that holds the same text
+ * shares one reference counted copy.  A variable that is exported is
+ * passed to the commands the shell spawns.
+ *
+ * The environment handed to posix_spawn is a vector of pointers to the
+ * exported strings.  It is rebuilt only after an exported variable was
+ * set, exported or unset, so running commands in a loop does not copy
+ * anything.  'NAME=value command' layers its assignments over that
+ * vector without touching the variables themselves.
+ */
+
+/* Import an environment; each of its variables is exported. */
+void variables_init(char **envp);
+
+/* Return the value of a variable, or NULL if it is not set.  The
+ * result is valid until the variable changes. */
+const char *variables_get(const char *name);
+const char *variables_lookup(const char *name, size_t len);
+
+/* True if the 'len' bytes at 'name' are a valid variable name:
+ * letters, digits and _, not starting with a digit. */
+bool variables_is_name(const char *name, size_t len);
+
+/* Set a variable from 'assignment', which has the form NAME=value.
+ * A variable keeps being exported if it was. */
+void variables_assign(const char *assignment);
+void variables_set(const char *name, const char *value);
+
+/* Export NAME, or set and export it if 'word' is NAME=value.  NAME
+ * need not be set.  Returns false if it is not a valid name. */
+bool variables_export(const char *word);
+
+void variables_unset(const char *name);
+
+/* Print the exported variables, sorted, as export commands. */
+void variables_print_exported(void);
+
+/* The environment for spawned commands, NULL terminated.  It belongs
+ * to this module and is valid until the next change to a variable. */
+char **variables_environ(void);
+
+/* The environment with 'assignments', NAME=value strings, layered over
+ * it, for 'NAME=value command'.  Only the vector of pointers is new; it
+ * shares the strings of the environment and of 'assignments', which
+ * must stay alive while it is used.  Free it with free(). */
+char **variables_environ_with(char *const *assignments);
+
+/* Replace $name, ${name}, $? (by 'status') and $$ in 'word'.  Unset
+ * variables expand to nothing and a '$' that starts none of these is
+ * kept.  Returns 'word' itself if it has no '$', else a copy allocated
+ * from 'arena'. */
+char *variables_expand(struct arena *arena, char *word, int status);
+
+#endif /* __VARIABLES_H */
@@ -0,0 +1,90 @@
+#!/usr/bin/python
+#
+# variables_test: tests shell variables, export, unset and NAME=value cmd
+#
+# Checks which variables reach the environment of a command, and when
+#
+
+import sys, imp, atexit, pexpect, proc_check, signal, time, threading
+from testutils import *
+
+console = setup_tests()
+
+# ensure that shell prints expected prompt
+expect_prompt()
+
+# assignments and $name, ${name}
+sendline('greeting=hel')
+expect_prompt()
+sendline('echo ${greeting}lo $greeting$greeting')
+expect_exact("hello helhel", "variables were not expanded")
+expect_prompt()
+
+# a variable is not in the environment until it is exported
+sendline('printenv greeting || echo not_exported | rev')
+expect_exact("detropxe_ton", "an unexported variable reached the environment")
+expect_prompt()
+sendline('export greeting')
+expect_prompt()
+sendline('printenv greeting | rev')
+expect_exact("leh", "export did not pass the variable on")
+expect_prompt()
+
+# later assignments to an exported variable are passed on too
+sendline('greeting=olleh')
+expect_prompt()
+sendline('printenv greeting | rev')
+expect_exact("hello", "a changed exported variable was not passed on")
+expect_prompt()
+
+# NAME=value cmd sets NAME only for that command
+sendline('CUSH_ONCE=ecno printenv CUSH_ONCE | rev')
+expect_exact("once", "prefix assignment did not reach the command")
+expect_prompt()
+sendline('printenv CUSH_ONCE || echo was_temporary | rev')
+expect_exact("yraropmet_saw", "prefix assignment outlived its command")
+expect_prompt()
+sendline('greeting=ereh printenv greeting | rev')
+expect_exact("here", "prefix assignment did not override an exported variable")
+expect_prompt()
+sendline('echo $greeting | rev')
+expect_exact("hello", "prefix assignment changed the variable")
+expect_prompt()
+
+# export NAME=value, and export lists what is exported
+sendline('export CUSH_LISTED=yes')
+expect_prompt()
+sendline('export')
+expect_exact('export CUSH_LISTED="yes"', "export did not list an exported variable")
+expect_prompt()
+
+# unset removes a variable and takes it out of the environment
+sendline('unset greeting')
+expect_prompt()
+sendline('printenv greeting || echo [$greeting] | rev')
+expect_exact("][", "unset did not remove the variable")
+expect_prompt()
+
+# $? is the status of the last pipeline
+sendline('false; echo status $?')
+expect_exact("status 1", "$? was not the last status")
+expect_prompt()
+
+# loops can build up a value
+sendline('for i in 1 2 3; do n=$i$n; done; echo $n')
+expect_exact("321", "assignments in a loop did not work")
+expect_prompt()
+
+# errors
+sendline('export 1x')
+expect_exact("export: 1x: not a valid identifier", "expected an error for a bad name")
+expect_prompt()
+sendline('x=1 | cat')
+expect_exact("Invalid null command.", "expected an error for an assignment in a pipeline")
+expect_prompt()
+
+#exit
+sendline("exit")
+expect_exact("exit\r\n", "Shell output extraneous characters")
+
+test_success()